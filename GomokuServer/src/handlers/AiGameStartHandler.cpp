@@ -29,20 +29,17 @@ void AiGameStartHandler::handle(const http::HttpRequest &req, http::HttpResponse
 
     // 创建一个ai机器人，它就while不断地执行下棋逻辑
     std::string reqFile("../WebApps/GomokuServer/resource/ChessGameVsAi.html");
-    FileUtil fileOperater(reqFile);
-    if (!fileOperater.isValid())
-    {
-        LOG_WARN << reqFile << "not exist.";
-        fileOperater.resetDefaultFile(); // FIXME:其实这里可能不必要，后续删了吧，不过其实也不会调用到毕竟详细地址是我服务端定义的
-    }
-
-    std::vector<char> buffer(fileOperater.size());
-    fileOperater.readFile(buffer);
-    std::string htmlContent(buffer.data(), buffer.size());
 
     resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
     resp->setCloseConnection(false);
     resp->setContentType("text/html");
-    resp->setContentLength(htmlContent.size());
-    resp->setBody(htmlContent);
+    if (!resp->setFileBody(reqFile))
+    {
+        LOG_WARN << reqFile << "not exist.";
+        resp->setStatusLine(req.getVersion(), http::HttpResponse::k404NotFound, "Not Found");
+        if (!resp->setFileBody(FileUtil::kDefaultFile)) // FIXME:其实这里可能不必要，后续删了吧，不过其实也不会调用到毕竟详细地址是我服务端定义的
+        {
+            resp->setContentLength(0);
+        }
+    }
 }
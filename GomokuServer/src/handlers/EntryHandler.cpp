@@ -5,20 +5,18 @@ void EntryHandler::handle(const http::HttpRequest& req, http::HttpResponse* resp
     // 因为是get请求，请求的url也拿到了，我们就可以直接返回响应了
     std::string reqFile;
     reqFile.append("../WebApps/GomokuServer/resource/entry.html");
-    FileUtil fileOperater(reqFile);
-    if (!fileOperater.isValid())
-    {
-        LOG_WARN << reqFile << " not exist";
-        fileOperater.resetDefaultFile(); // 404 NOT FOUND
-    }
 
-    std::vector<char> buffer(fileOperater.size());
-    fileOperater.readFile(buffer); // 读出文件数据
-    std::string bufStr = std::string(buffer.data(), buffer.size());
-    
     resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
     resp->setCloseConnection(false);
     resp->setContentType("text/html");
-    resp->setContentLength(bufStr.size());
-    resp->setBody(bufStr);
+    // 小文件直接读入响应体，较大的文件发送时分段读出，Content-Length随之设置
+    if (!resp->setFileBody(reqFile))
+    {
+        LOG_WARN << reqFile << " not exist";
+        resp->setStatusLine(req.getVersion(), http::HttpResponse::k404NotFound, "Not Found");
+        if (!resp->setFileBody(FileUtil::kDefaultFile)) // 404 NOT FOUND
+        {
+            resp->setContentLength(0); // 404页面也打不开时返回空响应体，连接可以继续复用
+        }
+    }
 }
@@ -34,9 +34,8 @@ void MenuHandler::handle(const http::HttpRequest &req, http::HttpResponse *resp)
             fileOperater.resetDefaultFile();
         }
 
-        std::vector<char> buffer(fileOperater.size());
-        fileOperater.readFile(buffer); // 读出文件数据
-        std::string htmlContent(buffer.data(), buffer.size());
+        std::string htmlContent;
+        fileOperater.readFile(htmlContent); // 读出文件数据
 
         // 在HTML内容中插入userId
         size_t headEnd = htmlContent.find("</head>");
@@ -52,7 +51,7 @@ void MenuHandler::handle(const http::HttpRequest &req, http::HttpResponse *resp)
         resp->setCloseConnection(false);
         resp->setContentType("text/html");
         resp->setContentLength(htmlContent.size());
-        resp->setBody(htmlContent);
+        resp->setBody(std::move(htmlContent));
     }
     catch (const std::exception &e)
     {
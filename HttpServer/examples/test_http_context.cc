@@ -0,0 +1,182 @@
+// HttpContext请求解析测试: chunked请求体、大小写不同的请求头、重复的Content-Length和Transfer-Encoding、
+// 非法的字段名、请求头和trailer的长度上限
+// 编译: g++ -std=c++17 -I../include test_http_context.cc ../src/http/HttpContext.cpp ../src/http/HttpRequest.cpp
+//           -o test_http_context -lmuduo_net -lmuduo_base -pthread
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "http/HttpContext.h"
+
+using http::HttpContext;
+using http::HttpRequest;
+
+namespace
+{
+
+struct Result
+{
+    bool        ok = true;
+    bool        gotAll = false;
+    std::string body; // 缓存的请求体
+    std::string streamed; // 交给读取函数的请求体
+    size_t      left = 0; // 缓冲区中剩下的字节数(下一个请求)
+};
+
+// 按parts分段喂给解析器，模拟请求分多次到达；stream为true时请求体交给读取函数
+Result parse(const std::vector<std::string>& parts, bool stream = false, HttpRequest* out = nullptr)
+{
+    HttpContext context;
+    muduo::net::Buffer buf;
+    Result result;
+    for (const std::string& part : parts)
+    {
+        buf.append(part);
+        result.ok = context.parseRequest(&buf, muduo::Timestamp());
+        if (result.ok && context.gotHeaders())
+        {
+            HttpRequest::BodyReader reader;
+            if (stream)
+            {
+                reader = [&result](const char* data, size_t len)
+                {
+                    result.streamed.append(data, len);
+                    return true;
+                };
+            }
+            context.startBody(std::move(reader), 1024);
+            result.ok = context.parseRequest(&buf, muduo::Timestamp());
+        }
+        if (!result.ok)
+        {
+            return result;
+        }
+    }
+    result.gotAll = context.gotAll();
+    result.body = context.request().getBody();
+    result.left = buf.readableBytes();
+    if (out)
+    {
+        out->swap(context.request());
+    }
+    return result;
+}
+
+void testChunked()
+{
+    // 块大小行带扩展，块数据和CRLF跨越多次到达，最后有trailer和下一个请求
+    Result r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nab",
+                      "c\r\n4;name=value\r\ndefg\r",
+                      "\n0\r\nTrailer: x\r\n\r\nGET"});
+    assert(r.ok && r.gotAll);
+    assert(r.body == "abcdefg");
+    assert(r.left == 3);
+
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n"}, true);
+    assert(r.ok && r.gotAll);
+    assert(r.body.empty() && r.streamed == "hello");
+
+    // 块大小不是十六进制数
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n"});
+    assert(!r.ok);
+}
+
+void testCaseInsensitiveHeaders()
+{
+    HttpRequest req;
+    Result r = parse({"POST /a HTTP/1.1\r\ntransfer-encoding: CHUNKED\r\nX-Token: t\r\n\r\n"
+                      "2\r\nok\r\n0\r\n\r\n"}, false, &req);
+    assert(r.ok && r.gotAll);
+    assert(r.body == "ok");
+    assert(req.getHeader("Transfer-Encoding") == "CHUNKED");
+    assert(req.getHeader("x-token") == "t");
+
+    r = parse({"POST /a HTTP/1.1\r\ncontent-length: 3\r\n\r\nabc"});
+    assert(r.ok && r.gotAll);
+    assert(r.body == "abc");
+
+    // 小写的Transfer-Encoding和Content-Length同时出现
+    r = parse({"POST /a HTTP/1.1\r\ntransfer-encoding: chunked\r\nContent-Length: 3\r\n\r\n"});
+    assert(!r.ok);
+}
+
+void testDuplicateHeaders()
+{
+    // 重复的Content-Length，不论值是否相同都拒绝
+    Result r = parse({"POST /a HTTP/1.1\r\nContent-Length: 3\r\ncontent-length: 3\r\n\r\nabc"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 5\r\n\r\nabc"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nContent-Length: 3, 3\r\n\r\nabc"});
+    assert(!r.ok);
+
+    // 多个Transfer-Encoding，分成多行或写在一行都拒绝
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding:\r\n\r\n"});
+    assert(!r.ok);
+
+    // 其他重复的头部合并成一个值
+    HttpRequest req;
+    r = parse({"GET /a HTTP/1.1\r\nAccept: a\r\naccept: b\r\nCookie: x=1\r\nCookie: sessionId=2\r\n\r\n"},
+              false, &req);
+    assert(r.ok && r.gotAll);
+    assert(req.getHeader("Accept") == "a, b");
+    assert(req.getHeader("Cookie") == "x=1; sessionId=2");
+}
+
+void testBadFieldNames()
+{
+    // 冒号前有空白时不能当作没有Content-Length，否则请求体会被当成下一个请求
+    Result r = parse({"POST /a HTTP/1.1\r\nContent-Length : 24\r\n\r\nGET /admin HTTP/1.1\r\n\r\n"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\n: 3\r\n\r\nabc"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nContent Length: 3\r\n\r\nabc"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\n Content-Length: 3\r\n\r\nabc"});
+    assert(!r.ok);
+}
+
+void testLimits()
+{
+    // 一直不发CRLF的请求行、请求头和trailer
+    std::string endless(100000, 'a');
+    Result r = parse({"GET /" + endless});
+    assert(!r.ok);
+    r = parse({"GET /a HTTP/1.1\r\nX-Long: " + endless});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n" + endless});
+    assert(!r.ok);
+
+    // 每行都不长，但总量超过上限
+    std::string many;
+    for (int i = 0; i < 2000; ++i)
+    {
+        many += "X-Field-" + std::to_string(i) + ": " + std::string(40, 'v') + "\r\n";
+    }
+    r = parse({"GET /a HTTP/1.1\r\n" + many + "\r\n"});
+    assert(!r.ok);
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n" + many + "\r\n"});
+    assert(!r.ok);
+
+    // 上限以内的trailer照常忽略
+    r = parse({"POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nx\r\n0\r\nA: b\r\n\r\n"});
+    assert(r.ok && r.gotAll && r.body == "x");
+}
+
+} // namespace
+
+int main()
+{
+    testChunked();
+    testCaseInsensitiveHeaders();
+    testDuplicateHeaders();
+    testBadFieldNames();
+    testLimits();
+    std::cout << "test_http_context passed" << std::endl;
+    return 0;
+}
@@ -1,40 +1,87 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 
 #include <muduo/net/TcpServer.h>
 
 #include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "../router/Router.h"
 
 namespace http
 {
 
-class HttpContext 
+class HttpContext
 {
 public:
     enum HttpRequestParseState
     {
         kExpectRequestLine, // 解析请求行
         kExpectHeaders, // 解析请求头
-        kExpectBody, // 解析请求体
+        kGotHeaders, // 请求头解析完成，等待startBody决定请求体的去向
+        kExpectBody, // 解析Content-Length请求体
+        kExpectChunkSize, // 解析chunked编码的块大小行
+        kExpectChunkData, // 解析块数据
+        kExpectChunkEnd, // 解析块数据后的CRLF
+        kExpectTrailers, // 解析最后一个块之后的trailer
         kGotAll, // 解析完成
+        kBodyTooLarge, // 缓存的请求体超过上限
+        kBodyAborted, // 流式读取函数放弃了请求体
     };
-    
+
     HttpContext()
     : state_(kExpectRequestLine)
     {}
 
+    // 返回false代表报文有误，此时可以通过state()区分错误原因
     bool parseRequest(muduo::net::Buffer* buf, muduo::Timestamp receiveTime);
-    bool gotAll() const 
+    bool gotAll() const
     { return state_ == kGotAll;  }
 
+    bool gotHeaders() const
+    { return state_ == kGotHeaders; }
+
+    HttpRequestParseState state() const
+    { return state_; }
+
+    // 请求头解析完成后调用，reader为空时请求体缓存到请求中，最多maxBodySize字节；
+    // 否则请求体到达一段就交给reader一段，不在内存中累积
+    void startBody(HttpRequest::BodyReader reader, uint64_t maxBodySize);
+
     void reset()
     {
         state_ = kExpectRequestLine;
-        HttpRequest dummyData;
-        request_.swap(dummyData);
+        request_ = HttpRequest();
+        reader_ = nullptr;
+        chunked_ = false;
+        bodyLeft_ = 0;
+        bodySize_ = 0;
+        headerBytes_ = 0;
+        route_ = nullptr;
+        routeResolved_ = false;
     }
 
+    // 请求头到达时已经查找过的路由(可能为空)，处理请求时直接分派，不再匹配一次路径
+    void setRoute(const router::Router::Target* route)
+    {
+        route_ = route;
+        routeResolved_ = true;
+    }
+
+    bool routeResolved() const
+    { return routeResolved_; }
+
+    const router::Router::Target* route() const
+    { return route_; }
+
+    // 头部之后还需分段发送响应体的响应，发送完之前不处理同一连接上的后续请求
+    void setStreamingResponse(std::unique_ptr<HttpResponse> response)
+    { streaming_ = std::move(response); }
+
+    HttpResponse* streamingResponse()
+    { return streaming_.get(); }
+
     const HttpRequest& request() const
     { return request_;}
 
@@ -43,9 +90,23 @@ public:
 
 private:
     bool processRequestLine(const char* begin, const char* end);
+    bool processHeadersEnd();
+    bool processChunkSize(const char* begin, const char* end);
+    bool addHeaderBytes(size_t len);
+    bool appendBody(const char* data, size_t len);
+    bool finishBody();
 private:
-    HttpRequestParseState state_;
-    HttpRequest           request_;
+    HttpRequestParseState    state_;
+    HttpRequest              request_;
+    HttpRequest::BodyReader  reader_; // 流式请求体的读取函数
+    bool                     chunked_ = false; // 是否为chunked编码
+    uint64_t                 bodyLeft_ = 0; // 当前Content-Length请求体或当前块剩余的字节数
+    uint64_t                 bodySize_ = 0; // 已收到的请求体字节数
+    uint64_t                 maxBodySize_ = 0; // 缓存请求体的上限
+    size_t                   headerBytes_ = 0; // 已收到的请求头或trailer的字节数
+    const router::Router::Target* route_ = nullptr;
+    bool                     routeResolved_ = false;
+    std::unique_ptr<HttpResponse> streaming_; // 正在发送的响应
 };
 
-} // namespace http
\ No newline at end of file
+} // namespace http
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <map>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include <muduo/base/Timestamp.h>
@@ -9,19 +11,40 @@
 namespace http
 {
 
+// 请求头的键按不区分大小写的方式比较，可以直接用string_view查找
+struct HeaderLess
+{
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const;
+};
+
 class HttpRequest
 {
 public:
+    using HeaderMap = std::map<std::string, std::string, HeaderLess>;
+
     enum Method
     {
         kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions
     };
+
+    // 流式请求体的读取函数，每到达一段请求体调用一次，len为0表示请求体结束；
+    // 返回false表示放弃剩余的请求体
+    using BodyReader = std::function<bool (const char* data, size_t len)>;
+    // 暂停(true)或恢复(false)从连接读取请求体，可以拷贝出来在其他线程中调用
+    using FlowControl = std::function<void (bool pause)>;
     
     HttpRequest()
         : method_(kInvalid)
         , version_("Unknown")
     {
     }
+
+    // 请求从解析到处理只有一份，按引用传递；禁止拷贝，避免大请求体被意外复制
+    HttpRequest(const HttpRequest&) = delete;
+    HttpRequest& operator=(const HttpRequest&) = delete;
+    HttpRequest(HttpRequest&&) = default;
+    HttpRequest& operator=(HttpRequest&&) = default;
     
     void setReceiveTime(muduo::Timestamp t);
     muduo::Timestamp receiveTime() const { return receiveTime_; }
@@ -30,31 +53,36 @@ public:
     Method method() const { return method_; }
 
     void setPath(const char* start, const char* end);
-    std::string path() const { return path_; }
+    // 以下访问函数返回引用，生命周期与请求相同；不存在的键返回空串
+    const std::string& path() const { return path_; }
 
-    void setPathParameters(const std::string &key, const std::string &value);
-    std::string getPathParameters(const std::string &key) const;
+    void setPathParameters(const std::string &key, std::string value);
+    const std::string& getPathParameters(const std::string &key) const;
 
     void setQueryParameters(const char* start, const char* end);
-    std::string getQueryParameters(const std::string &key) const;
+    const std::string& getQueryParameters(const std::string &key) const;
     
     void setVersion(std::string v)
     {
-        version_ = v;
+        version_ = std::move(v);
     }
 
-    std::string getVersion() const
+    const std::string& getVersion() const
     {
         return version_;
     }
     
-    void addHeader(const char* start, const char* colon, const char* end);
-    std::string getHeader(const std::string& field) const;
+    // 重复出现的头部按出现顺序用", "(Cookie用"; ")合并成一个值；
+    // 字段名为空或含有非token字符(包括冒号前的空白)时返回false
+    bool addHeader(const char* start, const char* colon, const char* end);
+    const std::string& getHeader(std::string_view field) const;
+    bool hasHeader(std::string_view field) const
+    { return headers_.count(field) > 0; }
 
-    const std::map<std::string, std::string>& headers() const
+    const HeaderMap& headers() const
     { return headers_; }
 
-    void setBody(const std::string& body) { content_ = body; }
+    void setBody(std::string&& body) { content_ = std::move(body); }
     void setBody(const char* start, const char* end) 
     { 
         if (end >= start) 
@@ -63,15 +91,31 @@ public:
         }
     }
     
-    std::string getBody() const
+    const std::string& getBody() const
     { return content_; }
 
+    void appendBody(const char* data, size_t len)
+    { content_.append(data, len); }
+
+    void reserveBody(size_t len)
+    { content_.reserve(len); }
+
+    // 处理器需要保留请求体时直接取走，不再拷贝
+    std::string takeBody()
+    { return std::move(content_); }
+
     void setContentLength(uint64_t length)
     { contentLength_ = length; }
     
     uint64_t contentLength() const
     { return contentLength_; }
 
+    void setBodyFlowControl(FlowControl control)
+    { flowControl_ = std::move(control); }
+
+    const FlowControl& bodyFlowControl() const
+    { return flowControl_; }
+
     void swap(HttpRequest& that);
 
 private:
@@ -81,9 +125,10 @@ private:
     std::unordered_map<std::string, std::string> pathParameters_; // 路径参数
     std::unordered_map<std::string, std::string> queryParameters_; // 查询参数
     muduo::Timestamp                             receiveTime_; // 接收时间
-    std::map<std::string, std::string>           headers_; // 请求头
+    HeaderMap                                    headers_; // 请求头
     std::string                                  content_; // 请求体
     uint64_t                                     contentLength_ { 0 }; // 请求体长度
+    FlowControl                                  flowControl_; // 流式请求体的读取控制
 };  
 
 } // namespace http
\ No newline at end of file
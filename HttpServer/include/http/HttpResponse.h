@@ -1,7 +1,13 @@
 #pragma once
 
+#include <functional>
+#include <memory>
+#include <string_view>
+
 #include <muduo/net/TcpServer.h>
 
+#include "../utils/SmallVector.h"
+
 namespace http
 {
 
@@ -22,9 +28,15 @@ public:
         k500InternalServerError = 500,
     };
 
+    // 分块生成响应体的函数：把下一块数据追加到chunk中，返回false表示这是最后一块。
+    // 生成函数在IO线程上同步调用，必须立即给出数据，不能等待；
+    // 追加的数据为空也表示响应体结束，之后不会再调用
+    using ChunkGenerator = std::function<bool (std::string& chunk)>;
+
     HttpResponse(bool close = true)
         : statusCode_(kUnknown)
         , closeConnection_(close)
+        , isFile_(false)
     {}
 
     void setVersion(std::string version)
@@ -44,14 +56,17 @@ public:
     bool closeConnection() const
     { return closeConnection_; }
     
-    void setContentType(const std::string& contentType)
-    { addHeader("Content-Type", contentType); }
+    // 常见的类型(application/json、text/html等)直接使用预先生成的整行头部
+    void setContentType(std::string_view contentType);
 
     void setContentLength(uint64_t length)
-    { addHeader("Content-Length", std::to_string(length)); }
+    {
+        contentLength_ = length;
+        hasContentLength_ = true;
+    }
 
-    void addHeader(const std::string& key, const std::string& value)
-    { headers_[key] = value; }
+    // 同名的头部会被替换，Content-Type和Content-Length转给上面两个函数
+    void addHeader(std::string_view key, std::string_view value);
     
     void setBody(const std::string& body)
     { 
@@ -59,6 +74,37 @@ public:
         // body_ += "\0";
     }
 
+    void setBody(std::string&& body)
+    { body_ = std::move(body); }
+
+    // 多个响应共用的只读响应体(如缓存的页面)，发送时直接从共享缓冲区写出，同时设置Content-Length
+    void setSharedBody(std::shared_ptr<const std::string> body);
+
+    // 以文件中的一段作为响应体，length为0表示到文件末尾，同时设置Content-Length。
+    // 小文件直接读入响应体；较大的文件保持打开，发送时每次读出一段，不整个读入内存。
+    // 发送期间文件被截断时bodyFailed()为true，连接会被关闭。文件打不开时返回false
+    bool setFileBody(const std::string& path, uint64_t offset = 0, uint64_t length = 0);
+
+    // 响应体由生成函数逐块产生，按 Transfer-Encoding: chunked 发送，不需要Content-Length
+    void setChunkedBody(ChunkGenerator generator);
+
+    // HTTP/1.0客户端不认识chunked：去掉Transfer-Encoding，块数据原样发送，
+    // 响应体以关闭连接结束。没有用setChunkedBody时不做任何事
+    void disableChunkedEncoding();
+
+    bool isFile() const
+    { return isFile_; }
+
+    // 头部之后还有需要分段发送的响应体，appendToBuffer不会写入这部分
+    bool hasStreamBody() const;
+
+    // 取下一段要发送的数据(约maxBytes字节)，piece在下次调用前有效；返回false表示这是最后一段
+    bool nextBodyPiece(size_t maxBytes, std::string_view* piece);
+
+    // 文件响应体没能读满Content-Length，此时nextBodyPiece返回false且piece为空
+    bool bodyFailed() const
+    { return bodyFailed_; }
+
     void setStatusLine(const std::string& version,
                          HttpStatusCode statusCode,
                          const std::string& statusMessage);
@@ -71,9 +117,34 @@ private:
     HttpStatusCode                     statusCode_;
     std::string                        statusMessage_;
     bool                               closeConnection_;
-    std::map<std::string, std::string> headers_;
+    struct Header
+    {
+        std::string key;
+        std::string value;
+    };
+    static const size_t kInlineHeaders = 8;
+
+    // 状态行、Date、Connection以及常见的Content-Type都是预先生成的整行，序列化时直接拷贝
+    void appendStatusLine(muduo::net::Buffer* outputBuf) const;
+
+    SmallVector<Header, kInlineHeaders> headers_; // 其余头部，按添加顺序输出
+    std::string_view                   contentTypeLine_; // 预先生成的Content-Type整行
+    std::string                        contentType_; // 不常见的Content-Type
+    uint64_t                           contentLength_ = 0;
+    bool                               hasContentLength_ = false;
+    struct FileRegion;
+
     std::string                        body_;
-    bool                               isFile_;
+    bool                               isFile_; // 响应体是文件
+    std::shared_ptr<const FileRegion>  file_; // 分段发送的文件区间
+    std::shared_ptr<const std::string> sharedBody_; // 共享的只读响应体
+    ChunkGenerator                     generator_; // 分块生成响应体的函数
+    bool                               generatorDone_ = false;
+    bool                               rawChunks_ = false; // 块数据不加分块编码
+    uint64_t                           streamOffset_ = 0; // 文件或共享响应体已取出的字节数
+    bool                               bodyFailed_ = false;
+    std::string                        streamBuffer_; // 从文件读出或带分块编码的待发送数据
+    std::string                        chunk_; // 生成函数的输出
 };
 
 } // namespace http
\ No newline at end of file
@@ -34,6 +34,8 @@ class HttpServer : muduo::noncopyable
 {
 public:
     using HttpCallback = std::function<void (const http::HttpRequest&, http::HttpResponse*)>;
+    // 总入口回调拿到的是可修改的请求，中间件和路由在其上原地处理
+    using RequestCallback = std::function<void (http::HttpRequest&, http::HttpResponse*)>;
     
     // 构造函数
     HttpServer(int port,
@@ -53,7 +55,8 @@ public:
         return server_.getLoop(); 
     }
 
-    void setHttpCallback(const HttpCallback& cb)
+    // 替换内置的中间件加路由处理，不设置时使用handleRequest
+    void setHttpCallback(const RequestCallback& cb)
     {
         httpCallback_ = cb;
     }
@@ -80,7 +83,8 @@ public:
         router_.registerHandler(HttpRequest::kPost, path, handler);
     }
 
-    // 注册动态路由处理器
+    // 注册动态路由处理器，路径中可以使用 ":name" 参数段(可带 <int>、<uint> 类型约束)和结尾的 "*name" 通配段，
+    // 处理器中用 req.getPathParameters("name") 取得参数
     void addRoute(HttpRequest::Method method, const std::string& path, router::Router::HandlerPtr handler)
     {
         router_.addRegexHandler(method, path, handler);
@@ -117,6 +121,12 @@ public:
 
     void setSslConfig(const ssl::SslConfig& config);
 
+    // 缓存到请求中的请求体上限，超过时回应413；流式读取的请求体不受此限制
+    void setMaxBodySize(uint64_t size)
+    {
+        maxBodySize_ = size;
+    }
+
 private:
     void initialize();
 
@@ -124,20 +134,27 @@ private:
     void onMessage(const muduo::net::TcpConnectionPtr& conn,
                    muduo::net::Buffer* buf,
                    muduo::Timestamp receiveTime);
-    void onRequest(const muduo::net::TcpConnectionPtr&, const HttpRequest&);
-
-    void handleRequest(const HttpRequest& req, HttpResponse* resp);
+    void onWriteComplete(const muduo::net::TcpConnectionPtr& conn);
+    void parseRequests(const muduo::net::TcpConnectionPtr& conn,
+                       muduo::net::Buffer* buf,
+                       muduo::Timestamp receiveTime);
+    bool onHeaders(const muduo::net::TcpConnectionPtr& conn, HttpContext* context);
+    void onRequest(const muduo::net::TcpConnectionPtr&, HttpRequest&, bool forceClose = false);
+    void rejectRequest(const muduo::net::TcpConnectionPtr& conn, HttpContext* context);
+
+    void handleRequest(HttpRequest& req, HttpResponse* resp, const HttpContext* context);
     
 private:
     muduo::net::InetAddress                      listenAddr_; // 监听地址
     muduo::net::TcpServer                        server_; 
     muduo::net::EventLoop                        mainLoop_; // 主循环
-    HttpCallback                                 httpCallback_; // 回调函数
+    RequestCallback                              httpCallback_; // 回调函数
     router::Router                               router_; // 路由
     std::unique_ptr<session::SessionManager>     sessionManager_; // 会话管理器
     middleware::MiddlewareChain                  middlewareChain_; // 中间件链
     std::unique_ptr<ssl::SslContext>             sslCtx_; // SSL 上下文
     bool                                         useSSL_; // 是否使用 SSL   
+    uint64_t                                     maxBodySize_ = 64 * 1024 * 1024; // 缓存请求体的上限
     // TcpConnectionPtr -> SslConnectionPtr 
     std::map<muduo::net::TcpConnectionPtr, std::unique_ptr<ssl::SslConnection>> sslConns_;
 }; 
@@ -1,10 +1,9 @@
 #pragma once
 #include <iostream>
-#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <functional>
-#include <regex>
 #include <vector>
 
 #include "RouterHandler.h"
@@ -19,38 +18,27 @@ namespace router
 // 选择注册对象式的路由处理器还是注册回调函数式的处理器取决于处理器执行的复杂程度
 // 如果是简单的处理可以注册回调函数，否则注册对象式路由处理器(对象中可封装多个相关函数)
 // 二者注册其一即可
+//
+// 每种请求方法一棵压缩前缀树(radix tree)，静态路径、":name"参数段和"*name"通配段
+// 都在同一次遍历中匹配，代价与路径长度成正比，与注册的路由数量无关。
+// 参数段可以带类型约束 ":name<int>"(可带负号的十进制整数)、":name<uint>"(非负十进制整数)，
+// 不满足约束的值不匹配该段。
+// 同一位置上静态段优先于参数段，带约束的参数段优先于不带约束的，参数段优先于通配段，
+// 匹配失败时回溯尝试下一种。
+// 例如 "/users/:id<uint>/posts/:postId"、"/static/*filepath"，参数按名字写入请求
 class Router
 {
 public:
     using HandlerPtr = std::shared_ptr<RouterHandler>;
     using HandlerCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
 
-    // 路由键（请求方法 + URI）
-    struct RouteKey
+    // 一条路由，参数名按在路径中出现的顺序保存，匹配时按位置对应。
+    // resolve返回的指针在Router的生命周期内有效，可以先查找、之后再分派
+    struct Target
     {
-        HttpRequest::Method method;
-        std::string path;
-
-        bool operator==(const RouteKey &other) const
-        {
-            return method == other.method && path == other.path;
-        }
-    };
-
-    // 为RouteKey 定义哈希函数
-    struct RouteKeyHash
-    {
-        // size_t operator()(const RouteKey& key) const
-        // {
-        //     return std::hash<int>{}(static_cast<int>(key.method)) ^
-        //            std::hash<std::string>{}(key.path);
-        // }
-        size_t operator()(const RouteKey &key) const
-        {
-            size_t methodHash = std::hash<int>{}(static_cast<int>(key.method));
-            size_t pathHash = std::hash<std::string>{}(key.path);
-            return methodHash * 31 + pathHash;
-        }
+        HandlerPtr handler_;
+        HandlerCallback callback_;
+        std::vector<std::string> paramNames_;
     };
 
     // 注册路由处理器
@@ -59,65 +47,69 @@ public:
     // 注册回调函数形式的处理器
     void registerCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback &callback);
 
-    // 注册动态路由处理器
+    // 注册动态路由处理器，与静态路由在同一棵树中
     void addRegexHandler(HttpRequest::Method method, const std::string &path, HandlerPtr handler)
     {
-        std::regex pathRegex = convertToRegex(path);
-        regexHandlers_.emplace_back(method, pathRegex, handler);
+        registerHandler(method, path, std::move(handler));
     }
 
     // 注册动态路由处理函数
     void addRegexCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback &callback)
     {
-        std::regex pathRegex = convertToRegex(path);
-        regexCallbacks_.emplace_back(method, pathRegex, callback);
+        registerCallback(method, path, callback);
     }
 
-    // 处理请求
-    bool route(const HttpRequest &req, HttpResponse *resp);
+    // 处理请求，匹配到的路径参数直接写入req
+    bool route(HttpRequest &req, HttpResponse *resp)
+    { return dispatch(resolve(req), req, resp); }
+
+    // 查找请求对应的路由并把路径参数写入req，没有匹配的路由时返回空
+    const Target *resolve(HttpRequest &req);
+
+    // 执行resolve找到的路由，target为空时返回false
+    bool dispatch(const Target *target, HttpRequest &req, HttpResponse *resp);
 
 private:
-    std::regex convertToRegex(const std::string &pathPattern)
-    { // 将路径模式转换为正则表达式，支持匹配任意路径参数
-        std::string regexPattern = "^" + std::regex_replace(pathPattern, std::regex(R"(/:([^/]+))"), R"(/([^/]+))") + "$";
-        return std::regex(regexPattern);
-    }
+    // 参数段的类型约束，按匹配时的尝试顺序排列
+    enum ParamType { kUint, kInt, kAny };
 
-    // 提取路径参数
-    void extractPathParameters(const std::smatch &match, HttpRequest &request)
+    struct Node;
+    struct ParamChild
     {
-        // Assuming the first match is the full path, parameters start from index 1
-        for (size_t i = 1; i < match.size(); ++i)
-        {
-            request.setPathParameters("param" + std::to_string(i), match[i].str());
-        }
-    }
+        ParamType type_;
+        std::unique_ptr<Node> node_;
+    };
 
-private:
-    struct RouteCallbackObj
+    struct Node
     {
-        HttpRequest::Method method_;
-        std::regex pathRegex_;
-        HandlerCallback callback_;
-        RouteCallbackObj(HttpRequest::Method method, std::regex pathRegex, const HandlerCallback &callback)
-            : method_(method), pathRegex_(pathRegex), callback_(callback) {}
+        std::string prefix_;                         // 静态节点要匹配的文本
+        std::vector<std::unique_ptr<Node>> statics_; // 静态子节点，首字符互不相同
+        std::vector<ParamChild> params_;             // ":name" 子节点，匹配到下一个'/'之前，按类型排序
+        std::unique_ptr<Node> wildcard_;             // "*name" 子节点，匹配剩余全部路径
+        std::unique_ptr<Target> target_;             // 路径在此结束时的路由
     };
 
-    struct RouteHandlerObj
+    // 路由模式拆分后的一段
+    struct Segment
     {
-        HttpRequest::Method method_;
-        std::regex pathRegex_;
-        HandlerPtr handler_;
-        RouteHandlerObj(HttpRequest::Method method, std::regex pathRegex, HandlerPtr handler)
-            : method_(method), pathRegex_(pathRegex), handler_(handler) {}
+        enum Kind { kStatic, kParam, kWildcard } kind;
+        std::string text; // 静态文本或参数名
+        ParamType type = kAny;
     };
 
-    std::unordered_map<RouteKey, HandlerPtr, RouteKeyHash>      handlers_;       // 精准匹配
-    std::unordered_map<RouteKey, HandlerCallback, RouteKeyHash> callbacks_; // 精准匹配
-    std::vector<RouteHandlerObj>                                regexHandlers_;     // 正则匹配
-    std::vector<RouteCallbackObj>                               regexCallbacks_;   // 正则匹配
+    static std::vector<Segment> parsePattern(const std::string &pattern);
+    Target &insert(HttpRequest::Method method, const std::string &pattern);
+    static Node *insertStatic(Node *node, std::string_view text);
+    static Node *insertParam(Node *node, ParamType type);
+    static bool checkParam(ParamType type, std::string_view value);
+    static const Target *match(const Node *node, std::string_view path,
+                               std::vector<std::string_view> &values);
+
+private:
+    static constexpr int kMethodCount = HttpRequest::kOptions + 1;
+    Node trees_[kMethodCount]; // 按请求方法区分的树
 };
 
 
 } // namespace router
-} // namespace http
\ No newline at end of file
+} // namespace http
@@ -14,6 +14,14 @@ class RouterHandler
 public:
     virtual ~RouterHandler() = default;
     virtual void handle(const HttpRequest& req, HttpResponse* resp) = 0;
+
+    // 需要流式接收请求体的处理器重写此函数。请求头解析完成后调用，返回的读取函数
+    // 在请求体每到达一段时调用一次，请求体不再缓存到req中，结束后照常调用handle。
+    // 读取函数在连接的IO线程中同步执行，返回之前不会再从该连接读取数据；
+    // 交给其他线程消费时可以用req.bodyFlowControl()暂停、恢复读取。
+    // 读取函数返回false时服务器立即调用handle生成响应，发送后关闭连接
+    virtual HttpRequest::BodyReader openBody(HttpRequest&)
+    { return nullptr; }
 };
 
 } // namespace router
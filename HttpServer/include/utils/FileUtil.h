@@ -9,6 +9,9 @@
 class FileUtil
 {
 public:
+    // 默认文件(404页面)
+    static constexpr const char* kDefaultFile = "/Gomoku/GomokuServer/resource/NotFound.html";
+
     FileUtil(std::string filePath)
         : filePath_(filePath)
         , file_(filePath, std::ios::binary) // 打开文件，二进制模式
@@ -27,7 +30,7 @@ public:
     void resetDefaultFile()
     {
         file_.close();
-        file_.open("/Gomoku/GomokuServer/resource/NotFound.html", std::ios::binary);
+        file_.open(kDefaultFile, std::ios::binary);
     }
 
     uint64_t size()
@@ -50,6 +53,20 @@ public:
         }
     }
 
+    // 直接读入字符串，需要修改内容再返回时省去一次拷贝
+    void readFile(std::string& content)
+    {
+        content.resize(size());
+        if (file_.read(&content[0], content.size()))
+        {
+            LOG_INFO << "File content load into memory (" << content.size() << " bytes)";
+        }
+        else
+        {
+            LOG_ERROR << "File read failed";
+        }
+    }
+
 private:
     std::string     filePath_;
     std::ifstream   file_;
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace http
+{
+
+// 前N个元素保存在对象内部的数组里，超出部分才放到堆上。
+// 适合元素个数通常很少、生命周期很短的场景(如响应头)，元素需要可默认构造
+template <typename T, size_t N>
+class SmallVector
+{
+public:
+    size_t size() const
+    { return size_; }
+
+    bool empty() const
+    { return size_ == 0; }
+
+    T& operator[](size_t i)
+    { return i < N ? inline_[i] : overflow_[i - N]; }
+
+    const T& operator[](size_t i) const
+    { return i < N ? inline_[i] : overflow_[i - N]; }
+
+    void push_back(T value)
+    {
+        if (size_ < N)
+        {
+            inline_[size_] = std::move(value);
+        }
+        else
+        {
+            overflow_.push_back(std::move(value));
+        }
+        ++size_;
+    }
+
+    void pop_back()
+    {
+        --size_;
+        if (size_ >= N)
+        {
+            overflow_.pop_back();
+        }
+        else
+        {
+            inline_[size_] = T(); // 释放元素持有的资源
+        }
+    }
+
+    // 删除第i个元素，后面的元素依次前移，保持顺序
+    void erase(size_t i)
+    {
+        for (; i + 1 < size_; ++i)
+        {
+            (*this)[i] = std::move((*this)[i + 1]);
+        }
+        pop_back();
+    }
+
+    void clear()
+    {
+        while (size_ > 0)
+        {
+            pop_back();
+        }
+    }
+
+private:
+    std::array<T, N> inline_;
+    std::vector<T>   overflow_;
+    size_t           size_ = 0;
+};
+
+} // namespace http
@@ -1,11 +1,22 @@
 #include "../../include/http/HttpContext.h"
 
+#include <charconv>
+#include <strings.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
 namespace http
 {
 
+namespace
+{
+const size_t kMaxChunkSizeLine = 1024;
+// 请求行、请求头和trailer的单行上限，以及请求头或trailer整体的上限，防止对端一直不发CRLF或无限发送字段
+const size_t kMaxHeaderLine = 8 * 1024;
+const size_t kMaxHeaderSize = 64 * 1024;
+}
+
 // 将报文解析出来将关键信息封装到HttpRequest对象里面去
 bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
 {
@@ -18,12 +29,14 @@ bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
             const char *crlf = buf->findCRLF(); // 注意这个返回值边界可能有错
             if (crlf)
             {
-                ok = processRequestLine(buf->peek(), crlf);
+                ok = static_cast<size_t>(crlf - buf->peek()) <= kMaxHeaderLine &&
+                     processRequestLine(buf->peek(), crlf);
                 if (ok)
                 {
                     request_.setReceiveTime(receiveTime);
                     buf->retrieveUntil(crlf + 2);
                     state_ = kExpectHeaders;
+                    headerBytes_ = 0;
                 }
                 else
                 {
@@ -32,53 +45,33 @@ bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
             }
             else
             {
+                ok = buf->readableBytes() <= kMaxHeaderLine;
                 hasMore = false;
             }
         }
         else if (state_ == kExpectHeaders)
         {
             const char *crlf = buf->findCRLF();
-            if (crlf)
+            if (crlf && !addHeaderBytes(crlf - buf->peek() + 2))
+            {
+                ok = false;
+                hasMore = false;
+            }
+            else if (crlf)
             {
                 const char *colon = std::find(buf->peek(), crlf, ':');
                 if (colon < crlf)
                 {
-                    request_.addHeader(buf->peek(), colon, crlf);
+                    // 字段名为空或含空白的行直接拒绝，否则"Content-Length :"之类的写法会让请求体被当成下一个请求
+                    ok = request_.addHeader(buf->peek(), colon, crlf);
+                    hasMore = ok;
                 }
                 else if (buf->peek() == crlf)
                 { 
                     // 空行，结束Header
-                    // 根据请求方法和Content-Length判断是否需要继续读取body
-                    if (request_.method() == HttpRequest::kPost || 
-                        request_.method() == HttpRequest::kPut)
-                    {
-                        std::string contentLength = request_.getHeader("Content-Length");
-                        if (!contentLength.empty())
-                        {
-                            request_.setContentLength(std::stoi(contentLength));
-                            if (request_.contentLength() > 0)
-                            {
-                                state_ = kExpectBody;
-                            }
-                            else
-                            {
-                                state_ = kGotAll;
-                                hasMore = false;
-                            }
-                        }
-                        else
-                        {
-                            // POST/PUT 请求没有 Content-Length，是HTTP语法错误
-                            ok = false;
-                            hasMore = false;
-                        }
-                    }
-                    else
-                    {
-                        // GET/HEAD/DELETE 等方法直接完成（没有请求体）
-                        state_ = kGotAll; 
-                        hasMore = false;
-                    }
+                    // 根据Transfer-Encoding和Content-Length判断是否需要继续读取body
+                    ok = processHeadersEnd();
+                    hasMore = false;
                 }
                 else
                 {
@@ -89,30 +82,240 @@ bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
             }
             else
             {
+                ok = buf->readableBytes() <= kMaxHeaderLine;
                 hasMore = false;
             }
         }
         else if (state_ == kExpectBody)
         {
-            // 检查缓冲区中是否有足够的数据
-            if (buf->readableBytes() < request_.contentLength())
+            // 请求体到达多少处理多少，只读取 Content-Length 指定的长度
+            size_t n = static_cast<size_t>(std::min<uint64_t>(buf->readableBytes(), bodyLeft_));
+            if (n == 0)
             {
                 hasMore = false; // 数据不完整，等待更多数据
-                return true;
             }
+            else
+            {
+                ok = appendBody(buf->peek(), n);
+                buf->retrieve(n);
+                bodyLeft_ -= n;
+                if (!ok)
+                {
+                    hasMore = false;
+                }
+                else if (bodyLeft_ == 0)
+                {
+                    ok = finishBody();
+                    hasMore = false;
+                }
+            }
+        }
+        else if (state_ == kExpectChunkSize)
+        {
+            const char *crlf = buf->findCRLF();
+            if (crlf)
+            {
+                ok = processChunkSize(buf->peek(), crlf);
+                buf->retrieveUntil(crlf + 2);
+                hasMore = ok;
+            }
+            else
+            {
+                // 块大小行不会很长，防止对端一直不发CRLF
+                ok = buf->readableBytes() <= kMaxChunkSizeLine;
+                hasMore = false;
+            }
+        }
+        else if (state_ == kExpectChunkData)
+        {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(buf->readableBytes(), bodyLeft_));
+            if (n == 0)
+            {
+                hasMore = false;
+            }
+            else
+            {
+                ok = appendBody(buf->peek(), n);
+                buf->retrieve(n);
+                bodyLeft_ -= n;
+                if (!ok)
+                {
+                    hasMore = false;
+                }
+                else if (bodyLeft_ == 0)
+                {
+                    state_ = kExpectChunkEnd;
+                }
+            }
+        }
+        else if (state_ == kExpectChunkEnd)
+        {
+            if (buf->readableBytes() < 2)
+            {
+                hasMore = false;
+            }
+            else if (buf->peek()[0] == '\r' && buf->peek()[1] == '\n')
+            {
+                buf->retrieve(2);
+                state_ = kExpectChunkSize;
+            }
+            else
+            {
+                ok = false;
+                hasMore = false;
+            }
+        }
+        else if (state_ == kExpectTrailers)
+        {
+            const char *crlf = buf->findCRLF();
+            if (crlf && !addHeaderBytes(crlf - buf->peek() + 2))
+            {
+                ok = false;
+                hasMore = false;
+            }
+            else if (crlf)
+            {
+                // trailer字段直接忽略，空行表示请求结束
+                bool end = (buf->peek() == crlf);
+                buf->retrieveUntil(crlf + 2);
+                if (end)
+                {
+                    ok = finishBody();
+                    hasMore = false;
+                }
+            }
+            else
+            {
+                ok = buf->readableBytes() <= kMaxHeaderLine;
+                hasMore = false;
+            }
+        }
+        else
+        {
+            // kGotHeaders等待startBody，kGotAll等待处理，其余为出错状态
+            ok = (state_ == kGotHeaders || state_ == kGotAll);
+            hasMore = false;
+        }
+    }
+    return ok; // ok为false代表报文语法解析错误
+}
 
-            // 只读取 Content-Length 指定的长度
-            std::string body(buf->peek(), buf->peek() + request_.contentLength());
-            request_.setBody(body);
+// 累计请求头或trailer的字节数，超过上限返回false
+bool HttpContext::addHeaderBytes(size_t len)
+{
+    headerBytes_ += len;
+    return len <= kMaxHeaderLine + 2 && headerBytes_ <= kMaxHeaderSize;
+}
 
-            // 准确移动读指针
-            buf->retrieve(request_.contentLength());
+// 请求头结束，Transfer-Encoding: chunked优先；两者都没有时请求没有请求体。
+// 重复的头部已合并成逗号分隔的一个值，所以多个Content-Length或多个编码都无法通过下面的检查
+bool HttpContext::processHeadersEnd()
+{
+    const std::string &transferEncoding = request_.getHeader("Transfer-Encoding");
+    const std::string &contentLength = request_.getHeader("Content-Length");
+    bool hasContentLength = request_.hasHeader("Content-Length");
+    if (request_.hasHeader("Transfer-Encoding"))
+    {
+        // 只支持单独的chunked；同时带Content-Length的请求可能被用来走私请求，直接拒绝
+        if (strcasecmp(transferEncoding.c_str(), "chunked") != 0 || hasContentLength)
+        {
+            return false;
+        }
+        chunked_ = true;
+        state_ = kGotHeaders;
+        return true;
+    }
 
-            state_ = kGotAll;
-            hasMore = false;
+    if (hasContentLength)
+    {
+        uint64_t length = 0;
+        const char *end = contentLength.data() + contentLength.size();
+        auto result = std::from_chars(contentLength.data(), end, length);
+        if (result.ec != std::errc() || result.ptr != end)
+        {
+            return false;
         }
+        request_.setContentLength(length);
+        state_ = length > 0 ? kGotHeaders : kGotAll;
+        return true;
     }
-    return ok; // ok为false代表报文语法解析错误
+
+    state_ = kGotAll;
+    return true;
+}
+
+void HttpContext::startBody(HttpRequest::BodyReader reader, uint64_t maxBodySize)
+{
+    assert(state_ == kGotHeaders);
+    reader_ = std::move(reader);
+    maxBodySize_ = maxBodySize;
+    if (chunked_)
+    {
+        state_ = kExpectChunkSize;
+    }
+    else if (!reader_ && request_.contentLength() > maxBodySize_)
+    {
+        // 不等请求体到达就拒绝，配合Expect: 100-continue客户端不必发送请求体
+        state_ = kBodyTooLarge;
+    }
+    else
+    {
+        bodyLeft_ = request_.contentLength();
+        if (!reader_)
+        {
+            request_.reserveBody(bodyLeft_);
+        }
+        state_ = kExpectBody;
+    }
+}
+
+// "1a3f;name=value" 块扩展直接忽略
+bool HttpContext::processChunkSize(const char *begin, const char *end)
+{
+    const char *semicolon = std::find(begin, end, ';');
+    uint64_t size = 0;
+    auto result = std::from_chars(begin, semicolon, size, 16);
+    if (result.ec != std::errc() || result.ptr != semicolon || begin == semicolon)
+    {
+        return false;
+    }
+    bodyLeft_ = size;
+    state_ = size > 0 ? kExpectChunkData : kExpectTrailers;
+    headerBytes_ = 0;
+    return true;
+}
+
+bool HttpContext::appendBody(const char *data, size_t len)
+{
+    bodySize_ += len;
+    if (reader_)
+    {
+        if (!reader_(data, len))
+        {
+            state_ = kBodyAborted;
+            return false;
+        }
+        return true;
+    }
+    if (bodySize_ > maxBodySize_)
+    {
+        state_ = kBodyTooLarge;
+        return false;
+    }
+    request_.appendBody(data, len);
+    return true;
+}
+
+bool HttpContext::finishBody()
+{
+    request_.setContentLength(bodySize_);
+    state_ = kGotAll;
+    if (reader_ && !reader_(nullptr, 0))
+    {
+        state_ = kBodyAborted;
+        return false;
+    }
+    return true;
 }
 
 // 解析请求行
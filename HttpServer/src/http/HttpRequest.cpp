@@ -1,8 +1,27 @@
 #include "../../include/http/HttpRequest.h"
 
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+
 namespace http
 {
 
+namespace
+{
+const std::string kEmpty;
+
+// RFC 7230中token允许的字符，头部字段名只能由这些字符组成
+bool isTokenChar(char c)
+{
+    if (isalnum(static_cast<unsigned char>(c)))
+    {
+        return true;
+    }
+    return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+}
+
 void HttpRequest::setReceiveTime(muduo::Timestamp t)
 {
     receiveTime_ = t;
@@ -45,29 +64,29 @@ void HttpRequest::setPath(const char *start, const char *end)
     path_.assign(start, end);
 }
 
-void HttpRequest::setPathParameters(const std::string &key, const std::string &value)
+void HttpRequest::setPathParameters(const std::string &key, std::string value)
 {
-    pathParameters_[key] = value;
+    pathParameters_[key] = std::move(value);
 }
 
-std::string HttpRequest::getPathParameters(const std::string &key) const
+const std::string &HttpRequest::getPathParameters(const std::string &key) const
 {
     auto it = pathParameters_.find(key);
     if (it != pathParameters_.end())
     {
         return it->second;
     }
-    return "";
+    return kEmpty;
 }
 
-std::string HttpRequest::getQueryParameters(const std::string &key) const
+const std::string &HttpRequest::getQueryParameters(const std::string &key) const
 {
     auto it = queryParameters_.find(key);
     if (it != queryParameters_.end())
     {
         return it->second;
     }
-    return "";
+    return kEmpty;
 }
 
 // 这是从问号后面分割参数
@@ -104,8 +123,18 @@ void HttpRequest::setQueryParameters(const char *start, const char *end)
     }
 }
 
-void HttpRequest::addHeader(const char *start, const char *colon, const char *end)
+bool HeaderLess::operator()(std::string_view a, std::string_view b) const
+{
+    int result = strncasecmp(a.data(), b.data(), std::min(a.size(), b.size()));
+    return result < 0 || (result == 0 && a.size() < b.size());
+}
+
+bool HttpRequest::addHeader(const char *start, const char *colon, const char *end)
 {
+    if (start == colon || !std::all_of(start, colon, isTokenChar))
+    {
+        return false;
+    }
     std::string key(start, colon);
     ++colon;
     while (colon < end && isspace(*colon))
@@ -117,18 +146,28 @@ void HttpRequest::addHeader(const char *start, const char *colon, const char *en
     {
         value.resize(value.size() - 1);
     }
-    headers_[key] = value;
+    auto it = headers_.find(key);
+    if (it == headers_.end())
+    {
+        headers_.emplace(std::move(key), std::move(value));
+    }
+    else
+    {
+        // Cookie的多个值按Cookie自己的分隔符合并
+        it->second.append(strcasecmp(it->first.c_str(), "Cookie") == 0 ? "; " : ", ");
+        it->second.append(value);
+    }
+    return true;
 }
 
-std::string HttpRequest::getHeader(const std::string &field) const
+const std::string &HttpRequest::getHeader(std::string_view field) const
 {
-    std::string result;
     auto it = headers_.find(field);
     if (it != headers_.end())
     {
-        result = it->second;
+        return it->second;
     }
-    return result;
+    return kEmpty;
 }
 
 void HttpRequest::swap(HttpRequest &that)
@@ -140,6 +179,9 @@ void HttpRequest::swap(HttpRequest &that)
     std::swap(version_, that.version_);
     std::swap(headers_, that.headers_);
     std::swap(receiveTime_, that.receiveTime_);
+    std::swap(content_, that.content_);
+    std::swap(contentLength_, that.contentLength_);
+    std::swap(flowControl_, that.flowControl_);
 }
 
 } // namespace http
\ No newline at end of file
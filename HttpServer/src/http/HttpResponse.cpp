@@ -1,40 +1,446 @@
 #include "../../include/http/HttpResponse.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace http
 {
 
-void HttpResponse::appendToBuffer(muduo::net::Buffer* outputBuf) const
+namespace
+{
+// 共享响应体不超过这个大小时直接和头部一起写出，省去一次单独发送
+const size_t kInlineSharedBody = 8 * 1024;
+// 不超过这个大小的文件在设置响应体时直接读入内存，和头部一起写出
+const size_t kInlineFileBody = 8 * 1024;
+
+const std::string_view kCRLF = "\r\n";
+const std::string_view kConnectionClose = "Connection: close\r\n";
+const std::string_view kConnectionKeepAlive = "Connection: Keep-Alive\r\n";
+
+struct StatusText
 {
-    // HttpResponse封装的信息格式化输出
-    char buf[32]; 
-    // 为什么不把状态信息放入格式化字符串中，因为状态信息有长有短，不方便定义一个固定大小的内存存储
-    snprintf(buf, sizeof buf, "%s %d ", httpVersion_.c_str(), statusCode_);
-    
-    outputBuf->append(buf);
-    outputBuf->append(statusMessage_);
-    outputBuf->append("\r\n");
+    int         code;
+    const char *reason;
+};
+
+const StatusText kStatusTexts[] = {
+    {200, "OK"},
+    {204, "No Content"},
+    {301, "Moved Permanently"},
+    {400, "Bad Request"},
+    {401, "Unauthorized"},
+    {403, "Forbidden"},
+    {404, "Not Found"},
+    {409, "Conflict"},
+    {500, "Internal Server Error"},
+};
+const size_t kStatusCount = sizeof kStatusTexts / sizeof kStatusTexts[0];
+const char *const kVersions[] = {"HTTP/1.1", "HTTP/1.0"};
+
+const char *const kContentTypes[] = {
+    "application/json",
+    "application/json; charset=utf-8",
+    "text/html",
+    "text/html; charset=utf-8",
+    "text/plain",
+    "text/plain; charset=utf-8",
+    "text/css",
+    "application/javascript",
+    "image/png",
+    "image/jpeg",
+    "image/x-icon",
+};
+const size_t kContentTypeCount = sizeof kContentTypes / sizeof kContentTypes[0];
 
-    if (closeConnection_) // 思考一下这些地方是不是可以直接移入近headers_中
+// 进程内只生成一次的整行文本
+struct PrerenderedLines
+{
+    std::string status[2][kStatusCount]; // [版本][状态码]
+    std::string contentType[kContentTypeCount];
+
+    PrerenderedLines()
     {
-        outputBuf->append("Connection: close\r\n");
+        for (size_t v = 0; v < 2; ++v)
+        {
+            for (size_t i = 0; i < kStatusCount; ++i)
+            {
+                status[v][i] = std::string(kVersions[v]) + " " + std::to_string(kStatusTexts[i].code) +
+                               " " + kStatusTexts[i].reason + "\r\n";
+            }
+        }
+        for (size_t i = 0; i < kContentTypeCount; ++i)
+        {
+            contentType[i] = std::string("Content-Type: ") + kContentTypes[i] + "\r\n";
+        }
+    }
+};
+
+const PrerenderedLines &prerendered()
+{
+    static const PrerenderedLines lines;
+    return lines;
+}
+
+// 每个IO线程(每个EventLoop)缓存一份Date头，每秒最多格式化一次
+std::string_view dateLine()
+{
+    thread_local time_t cachedSecond = -1;
+    thread_local char line[64];
+    thread_local size_t length = 0;
+    time_t now = ::time(nullptr);
+    if (now != cachedSecond)
+    {
+        struct tm tm;
+        ::gmtime_r(&now, &tm);
+        length = ::strftime(line, sizeof line, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        cachedSecond = now;
+    }
+    return std::string_view(line, length);
+}
+
+void append(muduo::net::Buffer *outputBuf, std::string_view text)
+{
+    outputBuf->append(text.data(), text.size());
+}
+
+// 从offset处读满len字节，文件不够长时返回false
+bool preadFull(int fd, char *buf, size_t len, uint64_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::pread(fd, buf, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buf += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+}
+
+// 打开的文件区间，最后一个引用它的响应释放时关闭文件
+struct HttpResponse::FileRegion
+{
+    int      fd = -1;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+
+    ~FileRegion()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+};
+
+
+void HttpResponse::setSharedBody(std::shared_ptr<const std::string> body)
+{
+    body_.clear();
+    file_.reset();
+    isFile_ = false;
+    generator_ = nullptr;
+    streamOffset_ = 0;
+    sharedBody_ = std::move(body);
+    setContentLength(sharedBody_ ? sharedBody_->size() : 0);
+}
+
+bool HttpResponse::setFileBody(const std::string& path, uint64_t offset, uint64_t length)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || offset > static_cast<uint64_t>(st.st_size))
+    {
+        ::close(fd);
+        return false;
+    }
+    uint64_t available = static_cast<uint64_t>(st.st_size) - offset;
+    if (length == 0 || length > available)
+    {
+        length = available;
+    }
+
+    std::string body;
+    std::shared_ptr<FileRegion> region;
+    if (length <= kInlineFileBody)
+    {
+        body.resize(static_cast<size_t>(length));
+        bool ok = preadFull(fd, &body[0], body.size(), offset);
+        ::close(fd);
+        if (!ok)
+        {
+            return false;
+        }
     }
     else
     {
-        //snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-        //outputBuf->append(buf);
-        outputBuf->append("Connection: Keep-Alive\r\n");
+        // 发送时按段pread，文件在发送期间被截断只会少读到数据，不影响进程
+        region = std::make_shared<FileRegion>();
+        region->fd = fd;
+        region->offset = offset;
+        region->length = length;
+    }
+
+    body_ = std::move(body);
+    sharedBody_.reset();
+    generator_ = nullptr;
+    streamOffset_ = 0;
+    bodyFailed_ = false;
+    file_ = std::move(region);
+    isFile_ = true;
+    setContentLength(length);
+    return true;
+}
+
+void HttpResponse::setChunkedBody(ChunkGenerator generator)
+{
+    body_.clear();
+    file_.reset();
+    isFile_ = false;
+    sharedBody_.reset();
+    generator_ = std::move(generator);
+    generatorDone_ = false;
+    rawChunks_ = false;
+    hasContentLength_ = false;
+    addHeader("Transfer-Encoding", "chunked");
+}
+
+void HttpResponse::disableChunkedEncoding()
+{
+    if (generator_ == nullptr || rawChunks_)
+    {
+        return;
+    }
+    for (size_t i = 0; i < headers_.size(); ++i)
+    {
+        if (headers_[i].key == "Transfer-Encoding")
+        {
+            headers_.erase(i);
+            break;
+        }
     }
+    rawChunks_ = true;
+    closeConnection_ = true;
+}
+
+bool HttpResponse::hasStreamBody() const
+{
+    return file_ != nullptr ||
+           (sharedBody_ && sharedBody_->size() > kInlineSharedBody) ||
+           generator_ != nullptr;
+}
 
-    for (const auto& header : headers_)
-    { // 为什么这里不用格式化字符串？因为key和value的长度不定
-        outputBuf->append(header.first);
-        outputBuf->append(": "); 
-        outputBuf->append(header.second);
-        outputBuf->append("\r\n");
+bool HttpResponse::nextBodyPiece(size_t maxBytes, std::string_view* piece)
+{
+    if (file_)
+    {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(maxBytes, file_->length - streamOffset_));
+        streamBuffer_.resize(n);
+        ssize_t got;
+        do
+        {
+            got = ::pread(file_->fd, &streamBuffer_[0], n, static_cast<off_t>(file_->offset + streamOffset_));
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0)
+        {
+            // 文件被截断或读取出错，已经发出的Content-Length无法兑现
+            bodyFailed_ = true;
+            *piece = std::string_view();
+            return false;
+        }
+        *piece = std::string_view(streamBuffer_.data(), static_cast<size_t>(got));
+        streamOffset_ += static_cast<uint64_t>(got);
+        return streamOffset_ < file_->length;
+    }
+    if (sharedBody_)
+    {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(maxBytes, sharedBody_->size() - streamOffset_));
+        *piece = std::string_view(sharedBody_->data() + streamOffset_, n);
+        streamOffset_ += n;
+        return streamOffset_ < sharedBody_->size();
+    }
+
+    // 一次取若干块拼成一段，每块格式为 "大小(十六进制)\r\n数据\r\n"，以 "0\r\n\r\n" 结束；
+    // 不使用分块编码时直接拼接块数据
+    streamBuffer_.clear();
+    while (!generatorDone_ && streamBuffer_.size() < maxBytes)
+    {
+        chunk_.clear();
+        generatorDone_ = !generator_(chunk_) || chunk_.empty();
+        if (rawChunks_)
+        {
+            streamBuffer_.append(chunk_);
+        }
+        else if (!chunk_.empty())
+        {
+            char size[24];
+            char *end = std::to_chars(size, size + sizeof size - 2, chunk_.size(), 16).ptr;
+            *end++ = '\r';
+            *end++ = '\n';
+            streamBuffer_.append(size, end - size);
+            streamBuffer_.append(chunk_);
+            streamBuffer_.append("\r\n");
+        }
+    }
+    if (generatorDone_ && !rawChunks_)
+    {
+        streamBuffer_.append("0\r\n\r\n");
+    }
+    *piece = streamBuffer_;
+    return !generatorDone_;
+}
+
+void HttpResponse::setContentType(std::string_view contentType)
+{
+    for (size_t i = 0; i < kContentTypeCount; ++i)
+    {
+        if (contentType == kContentTypes[i])
+        {
+            contentTypeLine_ = prerendered().contentType[i];
+            contentType_.clear();
+            return;
+        }
+    }
+    contentTypeLine_ = std::string_view();
+    contentType_.assign(contentType.data(), contentType.size());
+}
+
+void HttpResponse::addHeader(std::string_view key, std::string_view value)
+{
+    if (key == "Content-Type")
+    {
+        setContentType(value);
+        return;
+    }
+    if (key == "Content-Length")
+    {
+        uint64_t length = 0;
+        auto result = std::from_chars(value.data(), value.data() + value.size(), length);
+        if (result.ec == std::errc() && result.ptr == value.data() + value.size())
+        {
+            setContentLength(length);
+            return;
+        }
+    }
+    for (size_t i = 0; i < headers_.size(); ++i)
+    {
+        if (headers_[i].key == key)
+        {
+            headers_[i].value.assign(value.data(), value.size());
+            return;
+        }
+    }
+    headers_.push_back(Header{std::string(key), std::string(value)});
+}
+
+// 常见的版本、状态码和标准原因短语组合直接使用预先生成的状态行；
+// 没有设置原因短语时使用标准短语，没有设置版本时按HTTP/1.1处理
+void HttpResponse::appendStatusLine(muduo::net::Buffer* outputBuf) const
+{
+    int version = -1;
+    if (httpVersion_.empty() || httpVersion_ == kVersions[0])
+    {
+        version = 0;
+    }
+    else if (httpVersion_ == kVersions[1])
+    {
+        version = 1;
+    }
+
+    const char *reason = nullptr;
+    for (size_t i = 0; i < kStatusCount; ++i)
+    {
+        if (kStatusTexts[i].code == statusCode_)
+        {
+            reason = kStatusTexts[i].reason;
+            if (version >= 0 && (statusMessage_.empty() || statusMessage_ == reason))
+            {
+                append(outputBuf, prerendered().status[version][i]);
+                return;
+            }
+            break;
+        }
+    }
+
+    char buf[32];
+    char *end = std::to_chars(buf, buf + sizeof buf, static_cast<int>(statusCode_)).ptr;
+    append(outputBuf, httpVersion_.empty() ? kVersions[0] : httpVersion_);
+    outputBuf->append(" ", 1);
+    outputBuf->append(buf, end - buf);
+    outputBuf->append(" ", 1);
+    append(outputBuf, statusMessage_.empty() && reason ? reason : statusMessage_);
+    append(outputBuf, kCRLF);
+}
+
+void HttpResponse::appendToBuffer(muduo::net::Buffer* outputBuf) const
+{
+    appendStatusLine(outputBuf);
+    append(outputBuf, closeConnection_ ? kConnectionClose : kConnectionKeepAlive);
+    append(outputBuf, dateLine());
+
+    if (!contentTypeLine_.empty())
+    {
+        append(outputBuf, contentTypeLine_);
+    }
+    else if (!contentType_.empty())
+    {
+        append(outputBuf, "Content-Type: ");
+        append(outputBuf, contentType_);
+        append(outputBuf, kCRLF);
+    }
+
+    if (hasContentLength_)
+    {
+        static const char kPrefix[] = "Content-Length: ";
+        char buf[64];
+        memcpy(buf, kPrefix, sizeof kPrefix - 1);
+        char *end = std::to_chars(buf + sizeof kPrefix - 1, buf + sizeof buf - 2, contentLength_).ptr;
+        *end++ = '\r';
+        *end++ = '\n';
+        outputBuf->append(buf, end - buf);
+    }
+
+    for (size_t i = 0; i < headers_.size(); ++i)
+    {
+        const Header &header = headers_[i];
+        append(outputBuf, header.key);
+        append(outputBuf, ": ");
+        append(outputBuf, header.value);
+        append(outputBuf, kCRLF);
+    }
+    append(outputBuf, kCRLF);
+
+    // 文件、较大的共享响应体和分块生成的响应体由服务器在头部之后分段发送
+    if (!hasStreamBody())
+    {
+        if (sharedBody_)
+        {
+            outputBuf->append(*sharedBody_);
+        }
+        else
+        {
+            outputBuf->append(body_);
+        }
     }
-    outputBuf->append("\r\n");
-    
-    outputBuf->append(body_);
 }
 
 void HttpResponse::setStatusLine(const std::string& version,
@@ -1,5 +1,7 @@
 #include "../../include/http/HttpServer.h"
 
+#include <strings.h>
+
 #include <any>
 #include <functional>
 #include <memory>
@@ -7,8 +9,20 @@
 namespace http
 {
 
+namespace
+{
+// 流式响应体每次交给连接的数据量，输出缓冲区写空后再取下一段
+const size_t kStreamPieceSize = 64 * 1024;
+
+HttpContext *getContext(const muduo::net::TcpConnectionPtr &conn)
+{
+    auto *holder = boost::any_cast<std::shared_ptr<HttpContext>>(conn->getMutableContext());
+    return holder ? holder->get() : nullptr;
+}
+}
+
 // 默认http回应函数
-void defaultHttpCallback(const HttpRequest &, HttpResponse *resp)
+void defaultHttpCallback(HttpRequest &, HttpResponse *resp)
 {
     resp->setStatusCode(HttpResponse::k404NotFound);
     resp->setStatusMessage("Not Found");
@@ -22,7 +36,6 @@ HttpServer::HttpServer(int port,
     : listenAddr_(port)
     , server_(&mainLoop_, listenAddr_, name, option)
     , useSSL_(useSSL)
-    , httpCallback_(std::bind(&HttpServer::handleRequest, this, std::placeholders::_1, std::placeholders::_2))
 {
     initialize();
 }
@@ -45,6 +58,8 @@ void HttpServer::initialize()
                   std::placeholders::_1,
                   std::placeholders::_2,
                   std::placeholders::_3));
+    server_.setWriteCompleteCallback(
+        std::bind(&HttpServer::onWriteComplete, this, std::placeholders::_1));
 }
 
 void HttpServer::setSslConfig(const ssl::SslConfig& config)
@@ -72,7 +87,8 @@ void HttpServer::onConnection(const muduo::net::TcpConnectionPtr& conn)
             sslConns_[conn] = std::move(sslConn);
             sslConns_[conn]->startHandshake();
         }
-        conn->setContext(HttpContext());
+        // HttpRequest不可拷贝，上下文放在堆上，boost::any里只保存指针
+        conn->setContext(std::make_shared<HttpContext>());
     }
     else 
     {
@@ -118,20 +134,7 @@ void HttpServer::onMessage(const muduo::net::TcpConnectionPtr &conn,
                 LOG_INFO << "onMessage decryptedBuf is not empty";
             }
         }
-        // HttpContext对象用于解析出buf中的请求报文，并把报文的关键信息封装到HttpRequest对象中
-        HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
-        if (!context->parseRequest(buf, receiveTime)) // 解析一个http请求
-        {
-            // 如果解析http报文过程中出错
-            conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-            conn->shutdown();
-        }
-        // 如果buf缓冲区中解析出一个完整的数据包才封装响应报文
-        if (context->gotAll())
-        {
-            onRequest(conn, context->request());
-            context->reset();
-        }
+        parseRequests(conn, buf, receiveTime);
     }
     catch (const std::exception &e)
     {
@@ -142,23 +145,149 @@ void HttpServer::onMessage(const muduo::net::TcpConnectionPtr &conn,
     }
 }
 
-void HttpServer::onRequest(const muduo::net::TcpConnectionPtr &conn, const HttpRequest &req)
+void HttpServer::parseRequests(const muduo::net::TcpConnectionPtr &conn,
+                               muduo::net::Buffer *buf,
+                               muduo::Timestamp receiveTime)
+{
+    // HttpContext对象用于解析出buf中的请求报文，并把报文的关键信息封装到HttpRequest对象中
+    HttpContext *context = getContext(conn);
+    if (context == nullptr)
+    {
+        // 连接上的请求已被拒绝，等待关闭
+        buf->retrieveAll();
+        return;
+    }
+    if (context->streamingResponse())
+    {
+        return; // 上一个响应还没发送完，数据留在缓冲区中，发送完后再解析
+    }
+    if (!context->parseRequest(buf, receiveTime)) // 解析一个http请求
+    {
+        // 如果解析http报文过程中出错
+        rejectRequest(conn, context);
+        return;
+    }
+    // 请求头已完整，先决定请求体的去向再继续解析请求体
+    if (context->gotHeaders())
+    {
+        if (!onHeaders(conn, context))
+        {
+            return;
+        }
+        if (!context->parseRequest(buf, receiveTime))
+        {
+            rejectRequest(conn, context);
+            return;
+        }
+    }
+    // 如果buf缓冲区中解析出一个完整的数据包才封装响应报文
+    if (context->gotAll())
+    {
+        onRequest(conn, context->request());
+        context->reset();
+    }
+}
+
+// 请求头解析完成：对象式处理器可以接管请求体，否则请求体缓存到请求中；
+// 客户端带 Expect: 100-continue 时，确认接收请求体后才让它发送。返回false表示已回应并关闭
+bool HttpServer::onHeaders(const muduo::net::TcpConnectionPtr &conn, HttpContext *context)
+{
+    HttpRequest &req = context->request();
+    const std::string &expect = req.getHeader("Expect");
+    if (!expect.empty() && strcasecmp(expect.c_str(), "100-continue") != 0)
+    {
+        conn->send("HTTP/1.1 417 Expectation Failed\r\n\r\n");
+        conn->shutdown();
+        conn->setContext(boost::any());
+        return false;
+    }
+
+    std::weak_ptr<muduo::net::TcpConnection> weakConn(conn);
+    req.setBodyFlowControl([weakConn](bool pause) {
+        muduo::net::TcpConnectionPtr c = weakConn.lock();
+        if (c)
+        {
+            pause ? c->stopRead() : c->startRead();
+        }
+    });
+
+    const router::Router::Target *target = router_.resolve(req);
+    context->setRoute(target);
+    context->startBody(target && target->handler_ ? target->handler_->openBody(req) : nullptr, maxBodySize_);
+    if (context->state() == HttpContext::kBodyTooLarge)
+    {
+        rejectRequest(conn, context);
+        return false;
+    }
+
+    if (!expect.empty() && req.getVersion() == "HTTP/1.1")
+    {
+        conn->send("HTTP/1.1 100 Continue\r\n\r\n");
+    }
+    return true;
+}
+
+// 解析出错或请求体被拒绝，回应后关闭连接，剩余的数据不再解析
+void HttpServer::rejectRequest(const muduo::net::TcpConnectionPtr &conn, HttpContext *context)
+{
+    switch (context->state())
+    {
+    case HttpContext::kBodyAborted:
+        // 处理器放弃了请求体，由它自己给出响应；响应体需要分段发送时，
+        // 由onWriteComplete发送完后关闭连接，这里不能清掉保存着响应的上下文
+        onRequest(conn, context->request(), true);
+        if (context->streamingResponse())
+        {
+            return;
+        }
+        break;
+    case HttpContext::kBodyTooLarge:
+        conn->send("HTTP/1.1 413 Payload Too Large\r\n\r\n");
+        break;
+    default:
+        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+        break;
+    }
+    conn->shutdown();
+    conn->setContext(boost::any()); // 之后到达的数据直接丢弃
+}
+
+void HttpServer::onRequest(const muduo::net::TcpConnectionPtr &conn, HttpRequest &req, bool forceClose)
 {
     const std::string &connection = req.getHeader("Connection");
-    bool close = ((connection == "close") ||
-                  (req.getVersion() == "HTTP/1.0" && connection != "Keep-Alive"));
+    bool close = (forceClose || strcasecmp(connection.c_str(), "close") == 0 ||
+                  (req.getVersion() == "HTTP/1.0" && strcasecmp(connection.c_str(), "Keep-Alive") != 0));
     HttpResponse response(close);
 
     // 根据请求报文信息来封装响应报文对象
-    httpCallback_(req, &response); // 执行onHttpCallback函数
+    HttpContext *context = getContext(conn);
+    if (httpCallback_)
+    {
+        httpCallback_(req, &response); // 执行onHttpCallback函数
+    }
+    else
+    {
+        handleRequest(req, &response, context);
+    }
+    if (req.getVersion() == "HTTP/1.0")
+    {
+        response.disableChunkedEncoding();
+    }
 
-    // 可以给response设置一个成员，判断是否请求的是文件，如果是文件设置为true，并且存在文件位置在这里send出去。
     muduo::net::Buffer buf;
     response.appendToBuffer(&buf);
-    // 打印完整的响应内容用于调试
-    LOG_INFO << "Sending response:\n" << buf.toStringPiece().as_string();
-
+    // 打印完整的响应内容用于调试，默认的INFO级别下不会格式化
+    LOG_DEBUG << "Sending response:\n" << buf.toStringPiece().as_string();
     conn->send(&buf);
+
+    // 文件、分块生成等响应体在头部写出后由onWriteComplete分段发送
+    if (response.hasStreamBody() && context)
+    {
+        context->setStreamingResponse(std::make_unique<HttpResponse>(std::move(response)));
+        // 发送完之前不再从连接读取，后续请求不会在输入缓冲区中无限积累
+        conn->stopRead();
+        return;
+    }
     // 如果是短连接的话，返回响应报文后就断开连接
     if (response.closeConnection())
     {
@@ -166,17 +295,89 @@ void HttpServer::onRequest(const muduo::net::TcpConnectionPtr &conn, const HttpR
     }
 }
 
+// 输出缓冲区写空时调用：取流式响应体的下一段交给连接，每次只发送一段，
+// 这样每次发送只会再触发一次回调，输出缓冲区中最多只积压一段
+void HttpServer::onWriteComplete(const muduo::net::TcpConnectionPtr &conn)
+{
+    HttpContext *context = getContext(conn);
+    HttpResponse *response = context ? context->streamingResponse() : nullptr;
+    if (response == nullptr || conn->outputBuffer()->readableBytes() > 0)
+    {
+        return;
+    }
+
+    std::string_view piece;
+    bool more = true;
+    while (piece.empty() && more)
+    {
+        more = response->nextBodyPiece(kStreamPieceSize, &piece);
+    }
+    if (!piece.empty())
+    {
+        conn->send(piece.data(), piece.size());
+    }
+    if (more)
+    {
+        return;
+    }
+    if (response->bodyFailed())
+    {
+        // 响应体比Content-Length短，只能关闭连接让客户端发现
+        LOG_ERROR << "response body ended early, closing connection";
+        context->setStreamingResponse(nullptr);
+        conn->shutdown();
+        return;
+    }
+
+    // 响应发送完毕
+    bool close = response->closeConnection();
+    context->setStreamingResponse(nullptr);
+    if (close)
+    {
+        conn->shutdown();
+        return;
+    }
+    conn->startRead();
+    // 发送期间到达的后续请求
+    muduo::net::Buffer *buf = conn->inputBuffer();
+    if (useSSL_)
+    {
+        auto it = sslConns_.find(conn);
+        if (it == sslConns_.end())
+        {
+            return;
+        }
+        buf = it->second->getDecryptedBuffer();
+    }
+    if (buf->readableBytes() > 0)
+    {
+        try
+        {
+            parseRequests(conn, buf, muduo::Timestamp::now());
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Exception in onWriteComplete: " << e.what();
+            conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+            conn->shutdown();
+        }
+    }
+}
+
 // 执行请求对应的路由处理函数
-void HttpServer::handleRequest(const HttpRequest &req, HttpResponse *resp)
+// 中间件、路由和处理器使用的都是连接上下文中的同一个请求对象；
+// 带请求体的请求在请求头到达时已经查找过路由，直接使用上下文中的结果
+void HttpServer::handleRequest(HttpRequest &req, HttpResponse *resp, const HttpContext *context)
 {
     try
     {
         // 处理请求前的中间件
-        HttpRequest mutableReq = req;
-        middlewareChain_.processBefore(mutableReq);
+        middlewareChain_.processBefore(req);
 
         // 路由处理
-        if (!router_.route(mutableReq, resp))
+        const router::Router::Target *target =
+            context && context->routeResolved() ? context->route() : router_.resolve(req);
+        if (!router_.dispatch(target, req, resp))
         {
             LOG_INFO << "请求的啥，url：" << req.method() << " " << req.path();
             LOG_INFO << "未找到路由，返回404";
@@ -1,6 +1,8 @@
 #include "../../include/router/Router.h"
 #include <muduo/base/Logging.h>
 
+#include <stdexcept>
+
 namespace http
 {
 namespace router
@@ -8,72 +10,308 @@ namespace router
 
 void Router::registerHandler(HttpRequest::Method method, const std::string &path, HandlerPtr handler)
 {
-    RouteKey key{method, path};
-    handlers_[key] = std::move(handler);
+    insert(method, path).handler_ = std::move(handler);
 }
 
 void Router::registerCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback &callback)
 {
-    RouteKey key{method, path};
-    callbacks_[key] = std::move(callback);
+    insert(method, path).callback_ = callback;
 }
 
-bool Router::route(const HttpRequest &req, HttpResponse *resp)
+bool Router::dispatch(const Target *target, HttpRequest &req, HttpResponse *resp)
 {
-    RouteKey key{req.method(), req.path()};
+    if (target == nullptr)
+    {
+        return false;
+    }
 
-    // 查找处理器
-    auto handlerIt = handlers_.find(key);
-    if (handlerIt != handlers_.end())
+    // 同一路径同时注册了处理器和回调时，处理器优先
+    if (target->handler_)
     {
-        handlerIt->second->handle(req, resp);
-        return true;
+        target->handler_->handle(req, resp);
+    }
+    else
+    {
+        target->callback_(req, resp);
+    }
+    return true;
+}
+
+const Router::Target *Router::resolve(HttpRequest &req)
+{
+    int method = req.method();
+    if (method < 0 || method >= kMethodCount)
+    {
+        return nullptr;
+    }
+
+    // 参数值指向请求路径，写入请求之前路径不会变化
+    thread_local std::vector<std::string_view> values;
+    values.clear();
+    const std::string &path = req.path();
+    const Target *target = match(&trees_[method], path, values);
+    if (target == nullptr)
+    {
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < values.size() && i < target->paramNames_.size(); ++i)
+    {
+        req.setPathParameters(target->paramNames_[i], std::string(values[i]));
+    }
+    return target;
+}
+
+// "/users/:id/*rest" -> 静态"/users/"，参数id，静态"/"，通配rest
+std::vector<Router::Segment> Router::parsePattern(const std::string &pattern)
+{
+    std::vector<Segment> segments;
+    size_t i = 0;
+    while (i < pattern.size())
+    {
+        char c = pattern[i];
+        bool segmentStart = (i == 0 || pattern[i - 1] == '/');
+        if (segmentStart && (c == ':' || c == '*'))
+        {
+            size_t end = pattern.find('/', i);
+            if (end == std::string::npos)
+            {
+                end = pattern.size();
+            }
+            std::string name = pattern.substr(i + 1, end - i - 1);
+            ParamType type = kAny;
+            size_t open = name.find('<');
+            if (c == ':' && open != std::string::npos)
+            {
+                // ":name<type>"
+                if (name.back() != '>')
+                {
+                    throw std::invalid_argument("unterminated parameter type: " + pattern);
+                }
+                std::string typeName = name.substr(open + 1, name.size() - open - 2);
+                if (typeName == "int")
+                {
+                    type = kInt;
+                }
+                else if (typeName == "uint")
+                {
+                    type = kUint;
+                }
+                else
+                {
+                    throw std::invalid_argument("unknown parameter type <" + typeName + ">: " + pattern);
+                }
+                name.resize(open);
+            }
+            if (name.empty())
+            {
+                throw std::invalid_argument("route parameter without a name: " + pattern);
+            }
+            if (c == '*' && end != pattern.size())
+            {
+                throw std::invalid_argument("wildcard must be the last segment: " + pattern);
+            }
+            segments.push_back({c == ':' ? Segment::kParam : Segment::kWildcard, std::move(name), type});
+            i = end;
+            continue;
+        }
+        size_t end = i;
+        while (end < pattern.size() &&
+               !((pattern[end] == ':' || pattern[end] == '*') && pattern[end - 1] == '/'))
+        {
+            ++end;
+        }
+        segments.push_back({Segment::kStatic, pattern.substr(i, end - i)});
+        i = end;
+    }
+    return segments;
+}
+
+Router::Target &Router::insert(HttpRequest::Method method, const std::string &pattern)
+{
+    if (method < 0 || method >= kMethodCount)
+    {
+        throw std::invalid_argument("invalid method for route: " + pattern);
+    }
+    Node *node = &trees_[method];
+    std::vector<std::string> names;
+    for (const Segment &segment : parsePattern(pattern))
+    {
+        switch (segment.kind)
+        {
+        case Segment::kStatic:
+            node = insertStatic(node, segment.text);
+            break;
+        case Segment::kParam:
+            node = insertParam(node, segment.type);
+            names.push_back(segment.text);
+            break;
+        case Segment::kWildcard:
+            if (!node->wildcard_)
+            {
+                node->wildcard_ = std::make_unique<Node>();
+            }
+            node = node->wildcard_.get();
+            names.push_back(segment.text);
+            break;
+        }
+    }
+    if (!node->target_)
+    {
+        node->target_ = std::make_unique<Target>();
+    }
+    else if (node->target_->paramNames_ != names)
+    {
+        LOG_WARN << "route " << pattern << " overrides parameter names of an existing route";
+    }
+    node->target_->paramNames_ = std::move(names);
+    return *node->target_;
+}
+
+// 在node之下插入静态文本，必要时拆分已有节点的公共前缀，返回文本结束处的节点
+Router::Node *Router::insertStatic(Node *node, std::string_view text)
+{
+    while (!text.empty())
+    {
+        Node *child = nullptr;
+        for (auto &s : node->statics_)
+        {
+            if (s->prefix_[0] == text[0])
+            {
+                child = s.get();
+                break;
+            }
+        }
+        if (child == nullptr)
+        {
+            node->statics_.push_back(std::make_unique<Node>());
+            node->statics_.back()->prefix_.assign(text.data(), text.size());
+            return node->statics_.back().get();
+        }
+
+        size_t common = 0;
+        while (common < text.size() && common < child->prefix_.size() &&
+               text[common] == child->prefix_[common])
+        {
+            ++common;
+        }
+        if (common < child->prefix_.size())
+        {
+            // 拆分: child变为公共前缀，原来的内容下移一层
+            auto rest = std::make_unique<Node>();
+            rest->prefix_ = child->prefix_.substr(common);
+            rest->statics_ = std::move(child->statics_);
+            rest->params_ = std::move(child->params_);
+            rest->wildcard_ = std::move(child->wildcard_);
+            rest->target_ = std::move(child->target_);
+            child->prefix_.resize(common);
+            child->statics_.clear();
+            child->statics_.push_back(std::move(rest));
+        }
+        node = child;
+        text.remove_prefix(common);
+    }
+    return node;
+}
+
+// 同一位置每种类型一个参数子节点，按ParamType的顺序插入，匹配时先试约束更严格的
+Router::Node *Router::insertParam(Node *node, ParamType type)
+{
+    auto it = node->params_.begin();
+    while (it != node->params_.end() && it->type_ < type)
+    {
+        ++it;
+    }
+    if (it == node->params_.end() || it->type_ != type)
+    {
+        it = node->params_.insert(it, ParamChild{type, std::make_unique<Node>()});
     }
+    return it->node_.get();
+}
 
-    // 查找回调函数
-    auto callbackIt = callbacks_.find(key);
-    if (callbackIt != callbacks_.end())
+bool Router::checkParam(ParamType type, std::string_view value)
+{
+    if (type == kAny)
     {
-        callbackIt->second(req, resp);
         return true;
     }
+    if (type == kInt && value.size() > 1 && value[0] == '-')
+    {
+        value.remove_prefix(1);
+    }
+    for (char c : value)
+    {
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    // 查找动态路由处理器
-    for (const auto &[method, pathRegex, handler] : regexHandlers_)
+const Router::Target *Router::match(const Node *node, std::string_view path,
+                                    std::vector<std::string_view> &values)
+{
+    if (path.empty())
     {
-        std::smatch match;
-        std::string pathStr(req.path());
-        // 如果方法匹配并且动态路由匹配，则执行处理器
-        if (method == req.method() && std::regex_match(pathStr, match, pathRegex))
+        if (node->target_)
         {
-            // Extract path parameters and add them to the request
-            HttpRequest newReq(req); // 因为这里需要用这一次所以是可以改的
-            extractPathParameters(match, newReq);
-            
-            handler->handle(newReq, resp);
-            return true;
+            return node->target_.get();
         }
+        // "/static/*filepath" 也匹配 "/static/"
+        if (node->wildcard_ && node->wildcard_->target_)
+        {
+            values.push_back(path);
+            return node->wildcard_->target_.get();
+        }
+        return nullptr;
     }
 
-    // 查找动态路由回调函数
-    for (const auto &[method, pathRegex, callback] : regexCallbacks_)
+    // 静态子节点首字符互不相同，最多只有一个候选
+    for (const auto &child : node->statics_)
     {
-        std::smatch match;
-        std::string pathStr(req.path());
-        // 如果方法匹配并且动态路由匹配，则执行回调函数
-        if (method == req.method() && std::regex_match(pathStr, match, pathRegex))
+        if (child->prefix_[0] != path[0])
         {
-             // Extract path parameters and add them to the request
-            HttpRequest newReq(req); // 因为这里需要用这一次所以是可以改的
-            extractPathParameters(match, newReq);
+            continue;
+        }
+        if (path.compare(0, child->prefix_.size(), child->prefix_) == 0)
+        {
+            const Target *target = match(child.get(), path.substr(child->prefix_.size()), values);
+            if (target)
+            {
+                return target;
+            }
+        }
+        break;
+    }
 
-            callback(req, resp);
-            return true;
+    if (!node->params_.empty())
+    {
+        size_t end = path.find('/');
+        std::string_view value = path.substr(0, end);
+        for (const ParamChild &child : node->params_)
+        {
+            if (value.empty() || !checkParam(child.type_, value))
+            {
+                continue;
+            }
+            values.push_back(value);
+            const Target *target = match(child.node_.get(), path.substr(value.size()), values);
+            if (target)
+            {
+                return target;
+            }
+            values.pop_back();
         }
     }
 
-    return false;
+    if (node->wildcard_ && node->wildcard_->target_)
+    {
+        values.push_back(path);
+        return node->wildcard_->target_.get();
+    }
+    return nullptr;
 }
 
 } // namespace router
-} // namespace http
\ No newline at end of file
+} // namespace http
@@ -5,6 +5,7 @@
  ************************************************************************/
 #define DEBUG_LOG
 #include "Service.hpp"
+#include "../../log_system/logs_code/ThreadPoll.hpp"
 #include <thread>
 using namespace std;
 
@@ -71,7 +71,7 @@ void SessionManager::cleanExpiredSessions()
 std::string SessionManager::getSessionIdFromCookie(const HttpRequest& req)
 {
     std::string sessionId;
-    std::string cookie = req.getHeader("Cookie");
+    const std::string &cookie = req.getHeader("Cookie");
 
     if (!cookie.empty())
     {
@@ -3,17 +3,25 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-Acceptor::Acceptor(eventLoop* loop, const InetAddress &listenAddr)
+#include "log/log.h"
+
+Acceptor::Acceptor(eventLoop* loop, const InetAddress &listenAddr, bool reusePort)
     : loop_(loop), acceptSocket_(), listening_(false) {
 
+    acceptSocket_.setReuseAddr(true);
+    acceptSocket_.setReusePort(reusePort);
     acceptSocket_.bindAddress(listenAddr.get_sockaddr_in());
     acceptChannel_ = std::make_shared<channel>(acceptSocket_.fd());
     acceptChannel_->set_read_callback([this]{ this->handleRead(); });
 }
 
-Acceptor::~Acceptor() {}
+Acceptor::~Acceptor() {
+    // fd归acceptSocket_所有，避免channel析构时重复关闭
+    acceptChannel_->set_fd(-1);
+}
 
 void Acceptor::listen() {
+    assert(loop_->is_in_loop_thread());
     listening_ = true;
     acceptSocket_.listenFD();
     acceptChannel_->set_events(EPOLLIN | EPOLLET);
@@ -21,9 +29,18 @@ void Acceptor::listen() {
 }
 
 void Acceptor::handleRead() {
-    struct sockaddr_in addr;
-    int connfd = acceptSocket_.acceptFD(&addr);
-    if(connfd >= 0) {
+    // 边缘触发，一直accept到没有新连接
+    while(true) {
+        struct sockaddr_in addr;
+        int connfd = acceptSocket_.acceptFD(&addr);
+        if(connfd < 0) {
+            int savedErrno = errno; /* 写日志可能改动errno */
+            if(savedErrno != EAGAIN && savedErrno != EWOULDBLOCK && savedErrno != EINTR) {
+                LOG_ERROR("Acceptor accept error: %s", strerror(savedErrno));
+            }
+            if(savedErrno == EINTR) continue;
+            return;
+        }
         InetAddress peerAddr(addr);
         if(newConnectionCallback_) {
             newConnectionCallback_(connfd, peerAddr);
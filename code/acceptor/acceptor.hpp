@@ -2,8 +2,10 @@
 
 #include <functional>
 
-#include <eventLoop/eventLoop.hpp>
-#include <channel/channel.hpp>
+#include "eventLoop/eventLoop.hpp"
+#include "channel/channel.hpp"
+#include "socket/inetAddress.hpp"
+#include "socket/socket.hpp"
 
 // 实现思路：
 // Acceptor主要用于监听新连接事件
@@ -11,6 +13,8 @@
 // 当有新客户端连接到来时触发读事件，Acceptor的回调负责accept()新连接
 // 然后将新连接fd注册到EventLoop中管理。
 // Acceptor需要绑定一个EventLoop（通常是主线程的main reactor）
+// 监听socket是边缘触发的，一次读事件会accept到EAGAIN为止
+// reusePort为true时多个Acceptor可以监听同一端口（每个sub reactor一个）
 
 
 
@@ -18,10 +22,17 @@ class Acceptor {
 public:
     using NewConnectionCallback = std::function<void (int sockfd, const InetAddress &)>;
 
-    Acceptor(eventLoop* loop, const InetAddress &listenAddr);
+    // 构造时完成socket/bind，失败抛出std::system_error
+    Acceptor(eventLoop* loop, const InetAddress &listenAddr, bool reusePort = false);
     ~Acceptor();
 
+    Acceptor(const Acceptor&) = delete;
+    Acceptor& operator=(const Acceptor&) = delete;
+
     void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    void setLinger(bool on) { acceptSocket_.setLinger(on); }
+
+    // 开始监听并注册到loop，必须在loop线程调用
     void listen();
     bool isListening() const { return listening_; }
 
@@ -1,12 +1,99 @@
 #include "buffer.hpp"
 
-Buffer::Buffer(int initBuffSize) : buffer_(initBuffSize), readPos_(0), writePos_(0) {}
+#include <algorithm>
+
+namespace {
+
+/* 每个线程一个块池, 只在本线程访问, 不需要加锁.
+   块可以在一个线程取出、在另一个线程归还, 块本身只是普通内存, 不影响正确性 */
+class BlockPool {
+public:
+    static const int CLASS_NUM = 3;
+    static const size_t MAX_BLOCK = 64 * 1024;
+
+    ~BlockPool();
+
+    /* 返回不小于need的块, 实际大小写入cap */
+    char* Get(size_t need, size_t* cap);
+    void Put(char* block, size_t cap);
+
+private:
+    static const size_t CLASS_SIZE[CLASS_NUM];
+    static const size_t MAX_FREE = 16;   /* 每种规格最多缓存的空闲块 */
+
+    std::vector<char*> free_[CLASS_NUM];
+};
+
+const size_t BlockPool::CLASS_SIZE[BlockPool::CLASS_NUM] = { 4 * 1024, 16 * 1024, 64 * 1024 };
+
+/* 线程退出时池已析构, 之后归还的块直接释放 */
+thread_local bool poolAlive = true;
+thread_local BlockPool pool;
+
+BlockPool::~BlockPool() {
+    poolAlive = false;
+    for(auto& list : free_) {
+        for(char* block : list) { delete[] block; }
+    }
+}
+
+char* BlockPool::Get(size_t need, size_t* cap) {
+    for(int i = 0; i < CLASS_NUM; i++) {
+        if(need <= CLASS_SIZE[i]) {
+            *cap = CLASS_SIZE[i];
+            if(free_[i].empty()) { return new char[CLASS_SIZE[i]]; }
+            char* block = free_[i].back();
+            free_[i].pop_back();
+            return block;
+        }
+    }
+    *cap = need;
+    return new char[need];
+}
+
+void BlockPool::Put(char* block, size_t cap) {
+    for(int i = 0; i < CLASS_NUM; i++) {
+        if(cap == CLASS_SIZE[i] && free_[i].size() < MAX_FREE) {
+            free_[i].push_back(block);
+            return;
+        }
+    }
+    delete[] block;
+}
+
+char* GetBlock(size_t need, size_t* cap) {
+    if(!poolAlive) {
+        *cap = need;
+        return new char[need];
+    }
+    return pool.Get(need, cap);
+}
+
+void PutBlock(char* block, size_t cap) {
+    if(!poolAlive) {
+        delete[] block;
+        return;
+    }
+    pool.Put(block, cap);
+}
+
+/* 没有分配块时Peek()/BeginWrite()返回的地址, 保证指针运算合法 */
+char emptyBlock[1] = { 0 };
+
+}
+
+Buffer::Buffer(int initBuffSize) : buffer_(nullptr), capacity_(0), initSize_(initBuffSize),
+                                   readPos_(0), writePos_(0) {}
+
+Buffer::~Buffer() {
+    Release_();
+}
 
 size_t Buffer::ReadableBytes() const {
     return writePos_ - readPos_;
 }
 size_t Buffer::WritableBytes() const {
-    return buffer_.size() - writePos_;
+    return capacity_ - writePos_;
 }
 
 size_t Buffer::PrependableBytes() const {
@@ -20,6 +107,10 @@ const char* Buffer::Peek() const {
 void Buffer::Retrieve(size_t len) {
     assert(len <= ReadableBytes());
     readPos_ += len;
+    if(readPos_ == writePos_) {
+        /* 数据全部取走, 块还给池子 */
+        Release_();
+    }
 }
 
 void Buffer::RetrieveUntil(const char* end) {
@@ -28,9 +119,7 @@ void Buffer::RetrieveUntil(const char* end) {
 }
 
 void Buffer::RetrieveAll() {
-    bzero(&buffer_[0], buffer_.size());
-    readPos_ = 0;
-    writePos_ = 0;
+    Release_();
 }
 
 std::string Buffer::RetrieveAllToStr() {
@@ -49,7 +138,7 @@ char* Buffer::BeginWrite() {
 
 void Buffer::HasWritten(size_t len) {
     writePos_ += len;
-} 
+}
 
 void Buffer::Append(const std::string& str) {
     Append(str.data(), str.length());
@@ -79,14 +168,21 @@ void Buffer::EnsureWriteable(size_t len) {
 }
 
 ssize_t Buffer::ReadFd(int fd, int* saveErrno) {
-    char buff[65535];
+    if(!buffer_) {
+        /* 空缓冲区先取能容纳initSize_的最小规格块, 只有部分请求的连接不会占着大块;
+           一次读到的数据更多时由备用块接住, 再按实际大小换成更大的规格 */
+        buffer_ = GetBlock(initSize_, &capacity_);
+    }
+
+    /* 分散读， 保证数据全部读完; 放不下的部分先读进池里的备用块 */
+    size_t spareCap = 0;
+    char* spare = GetBlock(BlockPool::MAX_BLOCK, &spareCap);
     struct iovec iov[2];
     const size_t writable = WritableBytes();
-    /* 分散读， 保证数据全部读完 */
     iov[0].iov_base = BeginPtr_() + writePos_;
     iov[0].iov_len = writable;
-    iov[1].iov_base = buff;
-    iov[1].iov_len = sizeof(buff);
+    iov[1].iov_base = spare;
+    iov[1].iov_len = spareCap;
 
     const ssize_t len = readv(fd, iov, 2);
     if(len < 0) {
@@ -96,9 +192,11 @@ ssize_t Buffer::ReadFd(int fd, int* saveErrno) {
         writePos_ += len;
     }
     else {
-        writePos_ = buffer_.size();
-        Append(buff, len - writable);
+        writePos_ = capacity_;
+        Append(spare, len - writable);
     }
+    PutBlock(spare, spareCap);
+    if(ReadableBytes() == 0) { Release_(); }
     return len;
 }
 
@@ -108,28 +206,44 @@ ssize_t Buffer::WriteFd(int fd, int* saveErrno) {
     if(len < 0) {
         *saveErrno = errno;
         return len;
-    } 
-    readPos_ += len;
+    }
+    Retrieve(len);
     return len;
 }
 
 char* Buffer::BeginPtr_() {
-    return &*buffer_.begin();
+    return buffer_ ? buffer_ : emptyBlock;
 }
 
 const char* Buffer::BeginPtr_() const {
-    return &*buffer_.begin();
+    return buffer_ ? buffer_ : emptyBlock;
 }
 
 void Buffer::MakeSpace_(size_t len) {
+    size_t readable = ReadableBytes();
     if(WritableBytes() + PrependableBytes() < len) {
-        buffer_.resize(writePos_ + len + 1);
-    } 
+        /* 换一个更大规格的块, 只拷贝未读的数据 */
+        size_t cap = 0;
+        char* block = GetBlock(std::max(readable + len, initSize_), &cap);
+        if(readable) { std::copy(Peek(), Peek() + readable, block); }
+        if(buffer_) { PutBlock(buffer_, capacity_); }
+        buffer_ = block;
+        capacity_ = cap;
+    }
     else {
-        size_t readable = ReadableBytes();
         std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, BeginPtr_());
-        readPos_ = 0;
-        writePos_ = readPos_ + readable;
-        assert(readable == ReadableBytes());
     }
-}
\ No newline at end of file
+    readPos_ = 0;
+    writePos_ = readable;
+    assert(readable == ReadableBytes());
+}
+
+void Buffer::Release_() {
+    if(buffer_) {
+        PutBlock(buffer_, capacity_);
+        buffer_ = nullptr;
+        capacity_ = 0;
+    }
+    readPos_ = 0;
+    writePos_ = 0;
+}
@@ -19,10 +19,17 @@
 // 缓存区（如环形缓冲区）可以用来存放暂时接收但未处理完的数据，
 // 或者在发送前将数据拼装好，从而减少系统调用次数，提高吞吐率。
 
+// 内存来自每个线程独立的块池（4/16/64 KiB三种规格，更大的直接new），
+// 数据被全部取走时立即把块还给池子，空闲的keep-alive连接不再占着历史最大的缓冲区。
+// 存储仍然是连续的一块，Peek()/BeginWrite()可以直接交给解析器和snprintf使用。
+
 class Buffer {
 public:
     Buffer(int initBuffSize = 1024);
-    ~Buffer() = default;
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
 
     size_t WritableBytes() const;       
     size_t ReadableBytes() const ;
@@ -53,8 +60,11 @@ private:
     char* BeginPtr_();
     const char* BeginPtr_() const;
     void MakeSpace_(size_t len);
+    void Release_();
 
-    std::vector<char> buffer_;
+    char* buffer_;       /* 池中的块, 没有数据时为nullptr */
+    size_t capacity_;
+    size_t initSize_;    /* 第一次分配的最小大小 */
     std::atomic<std::size_t> readPos_;
     std::atomic<std::size_t> writePos_;
 };
\ No newline at end of file
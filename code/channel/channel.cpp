@@ -1,6 +1,6 @@
 #include "channel.hpp"
 
-explicit channel::channel(int fd) : fd_(fd), events_(0), revents_(0) {}
+channel::channel(int fd) : fd_(fd), events_(0), revents_(0) {}
 
 channel::~channel()
 {
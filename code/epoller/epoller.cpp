@@ -24,55 +24,64 @@ epoller::~epoller()
 
 void epoller::epoll_add(const sp_channel& request, uint32_t events)
 {
+    int fd = request->get_fd();
     epoll_event ev = {};
     ev.events = events;
-    ev.data.fd = request->get_fd();
+    ev.data.ptr = request.get();
 
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, request->get_fd(), &ev) < 0)
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
     {
         throw std::system_error(errno, std::system_category(), "Failed to add channel");
     }
 
-    channel_map_[request->get_fd()] = request;
+    if (static_cast<size_t>(fd) >= channels_.size())
+    {
+        channels_.resize(fd + 1);
+    }
+    channels_[fd] = request;
 }
 
 void epoller::epoll_mod(const sp_channel& request, uint32_t events)
 {
+    int fd = request->get_fd();
     epoll_event ev = {};
     ev.events = events;
-    ev.data.fd = request->get_fd();
+    ev.data.ptr = request.get();
 
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, request->get_fd(), &ev) < 0)
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) < 0)
     {
-        throw std::system_error(errno, std::system_category(), "Failed to add channel");
+        throw std::system_error(errno, std::system_category(), "Failed to modify channel");
     }
 
-    // 确保channel_map中存在该fd
-    auto it = channel_map_.find(request->get_fd());
-    if (it != channel_map_.end())
+    // 确保表中存在该fd
+    if (static_cast<size_t>(fd) >= channels_.size())
     {
-        it->second = request;
+        channels_.resize(fd + 1);
     }
-    else
+    if (channels_[fd] != request)
     {
-        channel_map_[request->get_fd()] = request;
+        channels_[fd] = request;
     }
 }
 
 void epoller::epoll_del(const sp_channel& request)
 {
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, request->get_fd(), nullptr) < 0)
+    int fd = request->get_fd();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) < 0)
     {
         throw std::system_error(errno, std::system_category(), "Failed to delete channel");
     }
 
-    channel_map_.erase(request->get_fd());
+    if (static_cast<size_t>(fd) < channels_.size())
+    {
+        channels_[fd].reset();
+    }
 }
 
-std::vector<sp_channel> epoller::epoll(int timeout)
+void epoller::epoll(int timeout, std::vector<channel*>* active_channels)
 {
-    int event_count = epoll_wait(epoll_fd_, events_.data(), events_.size(), timeout);
-    std::vector<sp_channel> active_channels;
+    active_channels->clear();
+    int event_count = epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout);
 
     if (event_count < 0)
     {
@@ -81,25 +90,19 @@ std::vector<sp_channel> epoller::epoll(int timeout)
             throw std::system_error(errno, std::system_category(), "epoll_wait failed");
         }
         // 如果被信号中断，返回空列表
-        return active_channels;
+        return;
     }
 
-    for(int i = 0; i < event_count; i++)
+    for (int i = 0; i < event_count; i++)
     {
-        int fd = events_[i].data.fd;
-        uint32_t ev = events_[i].events;
-        auto it = channel_map_.find(fd);
-        
-        if (it != channel_map_.end())
-        {
-            it->second->set_revents(events_[i].events);
-            active_channels.push_back(it->second);
-        }
-        else
-        {
-            std::cerr << "No channel found for fd: " << fd << std::endl;
-        }
+        channel* ch = static_cast<channel*>(events_[i].data.ptr);
+        ch->set_revents(events_[i].events);
+        active_channels->push_back(ch);
     }
 
-    return active_channels;
-}
\ No newline at end of file
+    // 一次取满说明就绪事件可能更多，扩容以减少epoll_wait次数
+    if (static_cast<size_t>(event_count) == events_.size())
+    {
+        events_.resize(events_.size() * 2);
+    }
+}
@@ -1,7 +1,6 @@
 #pragma once
 // 容器
 #include <vector>
-#include <unordered_map>
 // 标准异常库
 #include <stdexcept>
 #include <system_error>
@@ -27,8 +26,10 @@ public:
     // 删除事件
     void epoll_del(const sp_channel& request);
 
-    // 获取发生事件的channel列表
-    std::vector<sp_channel> epoll(int timeout);
+    // 等待事件，把就绪的channel填入调用者复用的active_channels（先清空）
+    // epoll_event.data.ptr直接存channel指针，不做查表也不拷贝shared_ptr
+    // 注意：本轮中被epoll_del的channel可能仍在列表里，调用者要保证它活到本轮处理结束
+    void epoll(int timeout, std::vector<channel*>* active_channels);
 
 private:
 
@@ -38,9 +39,10 @@ private:
     // 存储epoll_wait返回的活跃事件
     std::vector<epoll_event> events_;
 
-    // 保存fd到channel的映射，用于快速查找
-    std::unordered_map<int, sp_channel> channel_map_;
+    // 以fd为下标的channel表，持有注册期间channel的所有权
+    // fd是内核分配的最小可用整数，平铺数组比哈希表更紧凑
+    std::vector<sp_channel> channels_;
 
-    // 定义最大事件数量
+    // events_的初始大小，一次填满后翻倍
     static const int MAX_EVENTS = 1024;
 };
\ No newline at end of file
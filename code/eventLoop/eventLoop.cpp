@@ -17,13 +17,17 @@ eventLoop::eventLoop() :
     // 将wakeup_channel_注册到epoller中，以便在有唤醒请求时能够触发相应的回调
     epoller_->epoll_add(wakeup_channel_, wakeup_channel_->get_events());
 
-    // 添加定时器的文件描述符到epoll中（如果定时器模块需要）
-    // 这里假设timer不需要单独的文件描述符
+    // timerfd和IO事件一样由epoll统一分发，epoll_wait不再需要计算超时时间
+    timer_channel_ = std::make_shared<channel>(timer_.fd());
+    timer_channel_->set_events(EPOLLIN);
+    timer_channel_->set_read_callback([this]() { this->timer_.handleRead(); });
+    epoller_->epoll_add(timer_channel_, timer_channel_->get_events());
 }
 
 eventLoop::~eventLoop()
 {
     wakeup_channel_->set_fd(-1);
+    timer_channel_->set_fd(-1); // timerfd由timer_关闭
     close(event_fd_);
 }
 
@@ -46,25 +50,20 @@ void eventLoop::loop()
     {
         try
         {
-            // 获取下一个定时器的超时时间
-            int timeout = timer_.getNextTick();
-
-            // 1.epoll_wait阻塞，等待就绪事件
-            auto ready_channels = epoller_->epoll(timeout);
+            // 1.epoll_wait阻塞，等待就绪事件（复用active_channels_，不再每轮分配）
+            // 定时器到期由timerfd的可读事件唤醒
+            epoller_->epoll(-1, &active_channels_);
             is_event_handling_ = true;
 
             // 2.处理每个就绪事件（不同channel绑定了不同的callback）
-            for (auto& channel : ready_channels)
+            for (channel* ch : active_channels_)
             {
-                channel->handle_events();
+                ch->handle_events();
             }
             is_event_handling_ = false;
 
             // 3.执⾏正在等待的函数（fd注册到epoll内核事件表）
             performPendingFunctions();
-
-            // 4.处理超时事件，到期了就从定时器⼩根堆中删除（定时器析构会EpollDel掉fd）
-            timer_.tick();
         }
         catch(const std::exception& e)
         {
@@ -95,17 +94,24 @@ void eventLoop::runInLoop(Function&& func)
 
 void eventLoop::queueInLoop(Function&& func)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    pending_functions_.emplace_back(std::move(func));
-    wakeUp();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_functions_.emplace_back(std::move(func));
+    }
+
+    // loop线程处理事件时投递的函数会在本轮末尾执行，无需唤醒
+    if (!is_in_loop_thread() || is_calling_pending_functions_)
+    {
+        wakeUp();
+    }
 }
 
-void eventLoop::epollerAdd(std::shared_ptr<channel> channel, int timeout = 0)
+void eventLoop::epollerAdd(std::shared_ptr<channel> channel, int timeout)
 {
     epoller_->epoll_add(channel, channel->get_events());
 }
 
-void eventLoop::epollerMod(std::shared_ptr<channel> channel, int timeout = 0)
+void eventLoop::epollerMod(std::shared_ptr<channel> channel, int timeout)
 {
     epoller_->epoll_mod(channel, channel->get_events());
 }
@@ -123,6 +129,24 @@ void eventLoop::shutDown(std::shared_ptr<channel> channel)
     }
 }
 
+void eventLoop::addTimer(int id, int timeout, const timeoutCallback& cb)
+{
+    assert(is_in_loop_thread());
+    timer_.add(id, timeout, cb);
+}
+
+void eventLoop::adjustTimer(int id, int timeout)
+{
+    assert(is_in_loop_thread());
+    timer_.adjust(id, timeout);
+}
+
+void eventLoop::cancelTimer(int id)
+{
+    assert(is_in_loop_thread());
+    timer_.cancel(id);
+}
+
 // 创建eventfd，设置为非阻塞和关闭时自动关闭
 int eventLoop::createEventfd()
 {
@@ -147,14 +171,6 @@ void eventLoop::handleRead()
     }
 }
 
-void eventLoop::handleUpdate(int fd, uint32_t events)
-{
-    // 当需要更新channel事件时调用
-    auto ch = std::make_shared<channel>(fd);
-    ch->set_events(events);
-    epoller_->epoll_mod(ch, events);
-}
-
 void eventLoop::wakeUp()
 {
     uint64_t one = 1;
@@ -169,11 +185,17 @@ void eventLoop::wakeUp()
 void eventLoop::performPendingFunctions()
 {
     std::vector<Function> funcs;
-    std::lock_guard<std::mutex> lock(mutex_);
-    funcs.swap(pending_functions_);
+    is_calling_pending_functions_ = true;
+
+    // 只在交换时持锁，回调中可能再次调用queueInLoop
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        funcs.swap(pending_functions_);
+    }
 
     for (auto& func : funcs)
     {
         func();
     }
+    is_calling_pending_functions_ = false;
 }
\ No newline at end of file
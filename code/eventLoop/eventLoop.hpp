@@ -63,6 +63,11 @@ public:
     // 只关闭连接(此时还可以把缓冲区数据写完再关闭)
     void shutDown(std::shared_ptr<channel> channel);
 
+    // 定时器接口，只能在loop线程中调用，id一般为连接的fd
+    void addTimer(int id, int timeout, const timeoutCallback& cb);
+    void adjustTimer(int id, int timeout);
+    void cancelTimer(int id);
+
 private:
 
     // 创建eventfd，类似管道的进程间通信⽅式
@@ -71,9 +76,6 @@ private:
     // eventfd的读回调函数（因为event_fd写了数据，所以触发可读事件，从event_fd读数据）
     void handleRead();
 
-    // eventfd的更新事件回调函数（更新监听事件）
-    void handleUpdate(int fd, uint32_t events);
-
     // 异步唤醒SubLoop的epoll_wait（向event_fd中写⼊数据）
     void wakeUp();
 
@@ -87,6 +89,9 @@ private:
     // 用于跨线程唤醒事件循环的文件描述符，通过createEventfd()函数创建
     int event_fd_;
 
+    // epoll返回的就绪channel，每轮复用
+    std::vector<channel*> active_channels_;
+
     // 封装event_fd_，⽤于异步唤醒的channel
     std::shared_ptr<channel> wakeup_channel_;
 
@@ -99,9 +104,12 @@ private:
     // 正在等待处理的函数
     std::vector<Function> pending_functions_;
 
-    // 定时器
+    // 定时器（时间轮），由timer_channel_上的timerfd驱动
     timer timer_;
 
+    // 封装timer_.fd()的channel
+    std::shared_ptr<channel> timer_channel_;
+
     std::atomic<bool> is_stop_; // 是否停⽌事件循环
     std::atomic<bool> is_looping_; // 是否正在事件循环
     std::atomic<bool> is_event_handling_; // 是否正在处理事件
@@ -0,0 +1,78 @@
+#include "eventLoopThread.hpp"
+
+eventLoopThread::eventLoopThread() : loop_(nullptr) {}
+
+eventLoopThread::~eventLoopThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (loop_ != nullptr)
+        {
+            // loop_指向线程栈上的对象，线程退出前会把它置空
+            loop_->stopLoop();
+        }
+    }
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+eventLoop* eventLoopThread::startLoop()
+{
+    assert(!thread_.joinable());
+    thread_ = std::thread(&eventLoopThread::threadFunc, this);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return loop_ != nullptr; });
+    return loop_;
+}
+
+void eventLoopThread::threadFunc()
+{
+    eventLoop loop;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loop_ = &loop;
+    }
+    cond_.notify_one();
+
+    loop.loop();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    loop_ = nullptr;
+}
+
+eventLoopThreadPool::eventLoopThreadPool(eventLoop* baseLoop, int numThreads)
+    : base_loop_(baseLoop),
+      num_threads_(numThreads),
+      started_(false)
+{
+    assert(base_loop_ != nullptr);
+    assert(num_threads_ >= 0);
+}
+
+void eventLoopThreadPool::start()
+{
+    assert(!started_);
+    assert(base_loop_->is_in_loop_thread());
+    started_ = true;
+
+    for (int i = 0; i < num_threads_; i++)
+    {
+        threads_.emplace_back(std::make_unique<eventLoopThread>());
+        loops_.push_back(threads_.back()->startLoop());
+    }
+}
+
+std::vector<eventLoop*> eventLoopThreadPool::getAllLoops() const
+{
+    assert(started_);
+    if (loops_.empty())
+    {
+        return std::vector<eventLoop*>(1, base_loop_);
+    }
+    return loops_;
+}
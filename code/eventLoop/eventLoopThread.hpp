@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "eventLoop/eventLoop.hpp"
+
+// 实现思路：
+// eventLoop必须在运行它的线程中构造（thread_id_在构造时记录）
+// eventLoopThread在新线程中创建eventLoop并运行loop()，通过条件变量把指针交给调用者
+// eventLoopThreadPool持有多个eventLoopThread，baseLoop由调用者所在线程运行
+
+// 运行一个eventLoop的线程（one loop per thread）
+class eventLoopThread
+{
+public:
+
+    eventLoopThread();
+    ~eventLoopThread();
+
+    // 禁用拷贝和赋值
+    eventLoopThread(const eventLoopThread&) = delete;
+    eventLoopThread& operator=(const eventLoopThread&) = delete;
+
+    // 启动线程，阻塞到线程内的eventLoop创建完成并返回它
+    eventLoop* startLoop();
+
+private:
+
+    void threadFunc();
+
+    eventLoop* loop_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+// eventLoop线程池，baseLoop之外再启动numThreads个loop线程
+class eventLoopThreadPool
+{
+public:
+
+    eventLoopThreadPool(eventLoop* baseLoop, int numThreads);
+    ~eventLoopThreadPool() = default;
+
+    eventLoopThreadPool(const eventLoopThreadPool&) = delete;
+    eventLoopThreadPool& operator=(const eventLoopThreadPool&) = delete;
+
+    // 启动所有loop线程，只能在baseLoop所在线程调用
+    void start();
+
+    // 所有loop（没有子线程时只有baseLoop）
+    std::vector<eventLoop*> getAllLoops() const;
+
+    bool started() const { return started_; }
+
+private:
+
+    eventLoop* base_loop_;
+    int num_threads_;
+    bool started_;
+    std::vector<std::unique_ptr<eventLoopThread>> threads_;
+    std::vector<eventLoop*> loops_;
+};
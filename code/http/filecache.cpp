@@ -0,0 +1,201 @@
+#include "filecache.h"
+
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+using namespace std;
+
+FileCache::FileCache() {
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(inotifyFd_ < 0 || stopFd_ < 0) {
+        /* 没有失效通知时不能缓存, 退化为每次打开文件 */
+        LOG_WARN("FileCache: inotify init error, cache disabled");
+        if(inotifyFd_ >= 0) { close(inotifyFd_); inotifyFd_ = -1; }
+        return;
+    }
+    watcher_ = thread(&FileCache::WatchLoop_, this);
+}
+
+FileCache::~FileCache() {
+    if(watcher_.joinable()) {
+        uint64_t one = 1;
+        ssize_t n = write(stopFd_, &one, sizeof(one));
+        (void)n;
+        watcher_.join();
+    }
+    Clear();
+    if(inotifyFd_ >= 0) { close(inotifyFd_); }
+    if(stopFd_ >= 0) { close(stopFd_); }
+}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+FileCache::EntryPtr FileCache::Get(const string& path, const string& type, int* code) {
+    if(inotifyFd_ < 0) {
+        return Open_(path, type, code);
+    }
+    {
+        shared_lock<shared_mutex> locker(mtx_);
+        auto it = entries_.find(path);
+        if(it != entries_.end()) {
+            return it->second;
+        }
+    }
+
+    /* 先注册目录再打开文件, 持锁期间到达的事件会在插入之后处理, 不会留下过期条目 */
+    lock_guard<shared_mutex> locker(mtx_);
+    auto it = entries_.find(path);
+    if(it != entries_.end()) {
+        return it->second;
+    }
+    string::size_type idx = path.find_last_of('/');
+    if(idx != string::npos) {
+        Watch_(path.substr(0, idx));
+    }
+    EntryPtr entry = Open_(path, type, code);
+    if(entry && entries_.size() < MAX_ENTRIES) {
+        entries_.emplace(path, entry);
+    }
+    return entry;
+}
+
+FileCache::EntryPtr FileCache::Open_(const string& path, const string& type, int* code) {
+    struct stat st;
+    if(stat(path.data(), &st) < 0 || S_ISDIR(st.st_mode)) {
+        *code = 404;
+        return nullptr;
+    }
+    if(!(st.st_mode & S_IROTH)) {
+        *code = 403;
+        return nullptr;
+    }
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        *code = 404;
+        return nullptr;
+    }
+    /* 以打开后的fd为准, 防止stat和open之间文件被替换 */
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        *code = 404;
+        return nullptr;
+    }
+
+    auto entry = make_shared<Entry>();
+    entry->fd = fd;
+    entry->size = st.st_size;
+    if(st.st_size <= SMALL_FILE) {
+        entry->data.resize(st.st_size);
+        off_t off = 0;
+        while(off < st.st_size) {
+            ssize_t n = pread(fd, &entry->data[off], st.st_size - off, off);
+            if(n <= 0) { break; }
+            off += n;
+        }
+        if(off == st.st_size) {
+            close(fd);
+            entry->fd = -1;
+        } else {
+            entry->data.clear();
+        }
+    }
+
+    char lastModified[64] = {0};
+    struct tm tm;
+    gmtime_r(&st.st_mtime, &tm);
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    char etag[64] = {0};
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"",
+             static_cast<unsigned long>(st.st_mtime), static_cast<unsigned long>(st.st_size));
+
+    entry->headers = "Content-type: " + type + "\r\n";
+    entry->headers += "Content-length: " + to_string(st.st_size) + "\r\n";
+    entry->headers += string("Last-Modified: ") + lastModified + "\r\n";
+    entry->headers += string("ETag: ") + etag + "\r\n";
+    return entry;
+}
+
+void FileCache::Watch_(const string& dir) {
+    if(dirWd_.count(dir)) { return; }
+    int wd = inotify_add_watch(inotifyFd_, dir.data(),
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if(wd < 0) {
+        LOG_WARN("FileCache: watch %s error", dir.data());
+        return;
+    }
+    wdDir_[wd] = dir;
+    dirWd_[dir] = wd;
+}
+
+void FileCache::Clear() {
+    lock_guard<shared_mutex> locker(mtx_);
+    entries_.clear();
+}
+
+void FileCache::EraseDir_(const string& dir) {
+    string prefix = dir + "/";
+    for(auto it = entries_.begin(); it != entries_.end(); ) {
+        if(it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FileCache::WatchLoop_() {
+    struct pollfd fds[2] = {
+        { inotifyFd_, POLLIN, 0 },
+        { stopFd_, POLLIN, 0 },
+    };
+    while(true) {
+        int ret = poll(fds, 2, -1);
+        if(ret < 0 && errno != EINTR) {
+            LOG_ERROR("FileCache: poll error");
+            break;
+        }
+        if(fds[1].revents & POLLIN) { break; }
+        if(fds[0].revents & POLLIN) { HandleEvents_(); }
+    }
+}
+
+void FileCache::HandleEvents_() {
+    alignas(struct inotify_event) char buf[4096];
+    while(true) {
+        ssize_t len = read(inotifyFd_, buf, sizeof(buf));
+        if(len <= 0) { break; }
+
+        lock_guard<shared_mutex> locker(mtx_);
+        for(char* p = buf; p < buf + len; ) {
+            auto event = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW) {
+                /* 事件丢失, 无法确定哪些文件变了 */
+                entries_.clear();
+                continue;
+            }
+            auto it = wdDir_.find(event->wd);
+            if(it == wdDir_.end()) { continue; }
+
+            if(event->len > 0) {
+                entries_.erase(it->second + "/" + event->name);
+            }
+            if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                /* 目录本身没了, 下次访问时重新注册 */
+                EraseDir_(it->second);
+                dirWd_.erase(it->second);
+                if(!(event->mask & IN_IGNORED)) {
+                    inotify_rm_watch(inotifyFd_, event->wd);
+                }
+                wdDir_.erase(it);
+            }
+        }
+    }
+}
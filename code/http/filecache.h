@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <shared_mutex>
+#include <unordered_map>
+#include <fcntl.h>        // open
+#include <unistd.h>       // close
+#include <sys/stat.h>     // stat
+#include <sys/inotify.h>  // inotify
+
+#include "../log/log.h"
+
+/* 静态文件缓存：
+   所有loop线程共享打开的文件描述符和预先生成好的响应头(Content-type/Content-length/Last-Modified/ETag),
+   命中时一次请求不再需要stat/open/mmap/munmap, 正文由sendfile从fd直接发送;
+   不超过SMALL_FILE的小文件直接缓存内容, 流水线上的多个小响应可以一次writev发完.
+   文件所在目录注册inotify, 文件被修改/删除/替换后由后台线程把对应条目移出缓存;
+   仍在发送中的连接持有Entry的shared_ptr, 发完后才关闭旧fd. */
+class FileCache {
+public:
+    struct Entry {
+        int fd = -1;          /* 小文件读入data后为-1 */
+        off_t size = 0;
+        std::string headers;  /* 以\r\n结尾的若干行, 不含空行 */
+        std::string data;     /* 小文件的内容, 可以和响应头合并在一次writev里发送 */
+
+        ~Entry() { if(fd >= 0) { close(fd); } }
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
+    static FileCache* Instance();
+
+    /* 失败时返回nullptr, code为404或403 */
+    EntryPtr Get(const std::string& path, const std::string& type, int* code);
+
+    void Clear();
+
+private:
+    FileCache();
+    ~FileCache();
+
+    EntryPtr Open_(const std::string& path, const std::string& type, int* code);
+    void Watch_(const std::string& dir);
+    void WatchLoop_();
+    void HandleEvents_();
+    void EraseDir_(const std::string& dir);
+
+    static const size_t MAX_ENTRIES = 1024;
+    static const off_t SMALL_FILE = 16 * 1024;
+
+    int inotifyFd_;
+    int stopFd_;
+    std::thread watcher_;
+
+    std::shared_mutex mtx_;
+    std::unordered_map<std::string, EntryPtr> entries_;
+    std::unordered_map<int, std::string> wdDir_;     /* inotify watch -> 目录 */
+    std::unordered_map<std::string, int> dirWd_;
+};
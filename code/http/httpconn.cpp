@@ -9,6 +9,8 @@ HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    bodyLeft_ = 0;
+    keepAlive_ = false;
 };
 
 HttpConn::~HttpConn() { 
@@ -22,12 +24,19 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     fd_ = fd;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    pending_.clear();
+    bodyLeft_ = 0;
+    keepAlive_ = false;
+    request_.Init();
     isClose_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
-    response_.UnmapFile();
+    response_.CloseFile();
+    request_.Release();
+    pending_.clear();
+    bodyLeft_ = 0;
     if(isClose_ == false){
         isClose_ = true; 
         userCount--;
@@ -65,54 +74,104 @@ ssize_t HttpConn::read(int* saveErrno) {
 
 ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
+    if(pending_.empty()) { return 0; }
     do {
-        len = writev(fd_, iov_, iovCnt_);
-        if(len <= 0) {
-            *saveErrno = errno;
-            break;
-        }
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
+        Pending& front = pending_.front();
+        if(front.headLen == 0 && front.bodyLeft > 0 && front.file->fd >= 0) {
+            /* 大文件正文从缓存的fd直接发送, 不经过用户态 */
+            off_t offset = front.offset;
+            len = sendfile(fd_, front.file->fd, &offset, front.bodyLeft);
+            if(len <= 0) {
+                /* 返回0说明文件在发送过程中被截断, 只能关闭连接 */
+                *saveErrno = (len < 0) ? errno : 0;
+                break;
             }
         }
         else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
+            /* 把排队的响应头和小文件正文拼成iovec一次发出, 遇到需要sendfile的正文为止 */
+            struct iovec iov[MAX_IOV];
+            int iovCnt = 0;
+            bool more = false;
+            const char* head = writeBuff_.Peek();
+            for(const Pending& p : pending_) {
+                if(iovCnt >= MAX_IOV - 1) { more = true; break; }
+                if(p.headLen > 0) {
+                    iov[iovCnt].iov_base = const_cast<char*>(head);
+                    iov[iovCnt++].iov_len = p.headLen;
+                    head += p.headLen;
+                }
+                if(p.bodyLeft == 0) { continue; }
+                if(p.file->fd >= 0) { more = true; break; }
+                iov[iovCnt].iov_base = const_cast<char*>(p.file->data.data() + p.offset);
+                iov[iovCnt++].iov_len = p.bodyLeft;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovCnt;
+            /* 后面还有正文时用MSG_MORE, 让响应头和正文开头合并成一个报文段 */
+            len = sendmsg(fd_, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+            if(len <= 0) {
+                *saveErrno = errno;
+                break;
+            }
         }
+        Consume_(len);
+        if(ToWriteBytes() == 0) { break; } /* 传输结束 */
     } while(isET || ToWriteBytes() > 10240);
     return len;
 }
 
-bool HttpConn::process() {
-    request_.Init();
-    if(readBuff_.ReadableBytes() <= 0) {
-        return false;
-    }
-    else if(request_.parse(readBuff_)) {
-        LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
-    } else {
-        response_.Init(srcDir, request_.path(), false, 400);
+void HttpConn::Consume_(size_t len) {
+    while(len > 0) {
+        Pending& p = pending_.front();
+        size_t n = 0;
+        if(p.headLen > 0) {
+            n = std::min(len, p.headLen);
+            writeBuff_.Retrieve(n);
+            p.headLen -= n;
+        }
+        else {
+            n = std::min(len, p.bodyLeft);
+            p.offset += n;
+            p.bodyLeft -= n;
+            bodyLeft_ -= n;
+        }
+        len -= n;
+        if(p.headLen == 0 && p.bodyLeft == 0) {
+            pending_.pop_front();
+        }
     }
+}
+
+bool HttpConn::process() {
+    /* 一次读到的多个流水线请求一起生成响应, 由write()合并发送 */
+    while(readBuff_.ReadableBytes() > 0 && pending_.size() < MAX_PIPELINE &&
+          writeBuff_.ReadableBytes() < MAX_BATCH_BYTES) {
+        HttpRequest::HTTP_CODE ret = request_.parse(readBuff_);
+        if(ret == HttpRequest::NO_REQUEST) {
+            /* 请求不完整, 已解析的状态保留在request_中, 等下一次读 */
+            break;
+        }
+        else if(ret == HttpRequest::GET_REQUEST) {
+            LOG_DEBUG("%s", request_.path().c_str());
+            keepAlive_ = request_.IsKeepAlive();
+            response_.Init(srcDir, request_.path(), keepAlive_, 200);
+        } else {
+            keepAlive_ = false;
+            response_.Init(srcDir, request_.path(), false, 400);
+        }
 
-    response_.MakeResponse(writeBuff_);
-    /* 响应头 */
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
+        size_t before = writeBuff_.ReadableBytes();
+        response_.MakeResponse(writeBuff_);
+        Pending p = { writeBuff_.ReadableBytes() - before, response_.File(), 0, 0 };
+        if(p.file) { p.bodyLeft = p.file->size; }
+        bodyLeft_ += p.bodyLeft;
+        pending_.push_back(std::move(p));
+        response_.CloseFile();
+        LOG_DEBUG("pending:%d to %d", (int)pending_.size(), ToWriteBytes());
 
-    /* 文件 */
-    if(response_.FileLen() > 0  && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
+        /* 连接要关闭时后面的请求不再处理 */
+        if(!keepAlive_) { break; }
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
-    return true;
+    return !pending_.empty();
 }
@@ -2,13 +2,16 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <sys/socket.h>  // send
+#include <sys/sendfile.h> // sendfile
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <deque>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
-#include "../buffer/buffer.h"
+#include "../buffer/buffer.hpp"
 #include "httprequest.h"
 #include "httpresponse.h"
 
@@ -37,11 +40,12 @@ public:
     bool process();
 
     int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+        return writeBuff_.ReadableBytes() + bodyLeft_; 
     }
 
+    /* 最近一个已完成请求的keep-alive, request_此时可能已解析了下一个请求的一半 */
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return keepAlive_;
     }
 
     static bool isET;
@@ -49,17 +53,31 @@ public:
     static std::atomic<int> userCount;
     
 private:
-   
+    /* 已生成、等待发送的响应. 响应头按顺序排在writeBuff_中 */
+    struct Pending {
+        size_t headLen;            /* writeBuff_中剩余的响应头字节数 */
+        FileCache::EntryPtr file;  /* 正文, 可能为空 */
+        off_t offset;              /* 正文已发送到的位置 */
+        size_t bodyLeft;           /* 正文剩余字节数 */
+    };
+
+    void Consume_(size_t len);
+
+    static const size_t MAX_PIPELINE = 16;          /* 一批最多处理的流水线请求数 */
+    static const size_t MAX_BATCH_BYTES = 64 * 1024; /* 一批响应头超过该值时先发送 */
+    static const int MAX_IOV = 64;
+
     int fd_;
     struct  sockaddr_in addr_;
 
     bool isClose_;
     
-    int iovCnt_;
-    struct iovec iov_[2];
-    
     Buffer readBuff_; // 读缓冲区
-    Buffer writeBuff_; // 写缓冲区
+    Buffer writeBuff_; // 写缓冲区(响应头)
+
+    std::deque<Pending> pending_;
+    size_t bodyLeft_;  // 所有排队响应的正文剩余字节数
+    bool keepAlive_;
 
     HttpRequest request_;
     HttpResponse response_;
@@ -11,50 +11,93 @@ const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
 void HttpRequest::Init() {
     method_ = path_ = version_ = body_ = "";
     state_ = REQUEST_LINE;
+    scanned_ = 0;
+    contentLength_ = 0;
     header_.clear();
     post_.clear();
+    arena_.Reset();
+}
+
+void HttpRequest::Release() {
+    Init();
+    arena_.Release();
 }
 
 bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+    string_view conn = GetHeader("Connection");
+    return conn.size() == 10 && strncasecmp(conn.data(), "keep-alive", 10) == 0 && version_ == "1.1";
+}
+
+string_view HttpRequest::Find_(const vector<Field>& fields, string_view key, bool ignoreCase) {
+    /* 字段很少, 线性查找比哈希表更快且不需要分配 */
+    for(const Field& field : fields) {
+        if(field.first.size() != key.size()) { continue; }
+        if(ignoreCase ? strncasecmp(field.first.data(), key.data(), key.size()) == 0
+                      : field.first == key) {
+            return field.second;
+        }
     }
-    return false;
+    return string_view();
 }
 
-bool HttpRequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";
-    if(buff.ReadableBytes() <= 0) {
-        return false;
+string_view HttpRequest::GetHeader(string_view key) const {
+    return Find_(header_, key, true);
+}
+
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
+    if(state_ == FINISH) {
+        Init();
     }
-    while(buff.ReadableBytes() && state_ != FINISH) {
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buff.Peek(), lineEnd);
-        switch(state_)
-        {
-        case REQUEST_LINE:
-            if(!ParseRequestLine_(line)) {
-                return false;
-            }
-            ParsePath_();
-            break;    
-        case HEADERS:
-            ParseHeader_(line);
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
-            }
-            break;
-        case BODY:
-            ParseBody_(line);
-            break;
-        default:
+    while(state_ != FINISH) {
+        const char* begin = buff.Peek();
+        size_t readable = buff.ReadableBytes();
+
+        if(state_ == BODY) {
+            if(readable < contentLength_) { return NO_REQUEST; }
+            ParseBody_(string_view(begin, contentLength_));
+            buff.Retrieve(contentLength_);
             break;
         }
-        if(lineEnd == buff.BeginWrite()) { break; }
-        buff.RetrieveUntil(lineEnd + 2);
+
+        /* memchr由glibc做了向量化, 只扫描上次没看过的部分 */
+        const char* lineEnd = static_cast<const char*>(
+            memchr(begin + scanned_, '\n', readable - scanned_));
+        if(!lineEnd) {
+            scanned_ = readable;
+            if(readable > MAX_LINE) { break; }
+            return NO_REQUEST;
+        }
+        string_view line(begin, lineEnd - begin);
+        if(!line.empty() && line.back() == '\r') { line.remove_suffix(1); }
+        if(line.size() > MAX_LINE) { break; }
+
+        bool ok = true;
+        if(state_ == REQUEST_LINE) {
+            ok = ParseRequestLine_(line);
+            if(ok) { ParsePath_(); }
+        }
+        else if(line.empty()) {
+            /* 头部结束 */
+            state_ = contentLength_ > 0 ? BODY : FINISH;
+            if(state_ == FINISH) { ParsePost_(); }
+        }
+        else {
+            ok = ParseHeader_(line);
+        }
+        buff.RetrieveUntil(lineEnd + 1);
+        scanned_ = 0;
+        if(!ok) { break; }
+    }
+
+    if(state_ != FINISH) {
+        LOG_ERROR("Bad request");
+        /* 清掉已解析的头部, 保证IsKeepAlive()为false */
+        Init();
+        state_ = FINISH;
+        return BAD_REQUEST;
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    return GET_REQUEST;
 }
 
 void HttpRequest::ParsePath_() {
@@ -71,36 +114,55 @@ void HttpRequest::ParsePath_() {
     }
 }
 
-bool HttpRequest::ParseRequestLine_(const string& line) {
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS;
-        return true;
+bool HttpRequest::ParseRequestLine_(string_view line) {
+    /* METHOD SP request-target SP HTTP/version */
+    size_t sp1 = line.find(' ');
+    size_t sp2 = (sp1 == string_view::npos) ? sp1 : line.find(' ', sp1 + 1);
+    if(sp1 == 0 || sp2 == string_view::npos || sp2 == sp1 + 1 ||
+       line.find(' ', sp2 + 1) != string_view::npos) {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    string_view version = line.substr(sp2 + 1);
+    if(version.substr(0, 5) != "HTTP/" || version.size() == 5) {
+        LOG_ERROR("RequestLine Error");
+        return false;
     }
-    LOG_ERROR("RequestLine Error");
-    return false;
+    method_.assign(line.data(), sp1);
+    path_.assign(line.data() + sp1 + 1, sp2 - sp1 - 1);
+    version_.assign(version.data() + 5, version.size() - 5);
+    state_ = HEADERS;
+    return true;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2];
+bool HttpRequest::ParseHeader_(string_view line) {
+    size_t colon = line.find(':');
+    if(colon == string_view::npos || colon == 0) {
+        return false;
     }
-    else {
-        state_ = BODY;
+    string_view key = line.substr(0, colon);
+    string_view value = line.substr(colon + 1);
+    while(!value.empty() && (value.front() == ' ' || value.front() == '\t')) { value.remove_prefix(1); }
+    while(!value.empty() && (value.back() == ' ' || value.back() == '\t')) { value.remove_suffix(1); }
+
+    if(key.size() == 14 && strncasecmp(key.data(), "Content-Length", 14) == 0) {
+        size_t len = 0;
+        for(char ch : value) {
+            if(ch < '0' || ch > '9') { return false; }
+            len = len * 10 + (ch - '0');
+            if(len > MAX_BODY) { return false; }
+        }
+        contentLength_ = len;
     }
+    header_.emplace_back(arena_.Copy(key), arena_.Copy(value));
+    return true;
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;
+void HttpRequest::ParseBody_(string_view body) {
+    body_.assign(body.data(), body.size());
     ParsePost_();
     state_ = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    LOG_DEBUG("Body:%s, len:%d", body_.c_str(), body_.size());
 }
 
 int HttpRequest::ConverHex(char ch) {
@@ -110,14 +172,14 @@ int HttpRequest::ConverHex(char ch) {
 }
 
 void HttpRequest::ParsePost_() {
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+    if(method_ == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded") {
         ParseFromUrlencoded_();
         if(DEFAULT_HTML_TAG.count(path_)) {
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag:%d", tag);
             if(tag == 0 || tag == 1) {
                 bool isLogin = (tag == 1);
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
+                if(UserVerify(GetPost("username"), GetPost("password"), isLogin)) {
                     path_ = "/welcome.html";
                 } 
                 else {
@@ -131,7 +193,8 @@ void HttpRequest::ParsePost_() {
 void HttpRequest::ParseFromUrlencoded_() {
     if(body_.size() == 0) { return; }
 
-    string key, value;
+    /* 先原地解码, 之后body_不再修改, 字段直接引用body_ */
+    string_view key;
     int num = 0;
     int n = body_.size();
     int i = 0, j = 0;
@@ -140,32 +203,31 @@ void HttpRequest::ParseFromUrlencoded_() {
         char ch = body_[i];
         switch (ch) {
         case '=':
-            key = body_.substr(j, i - j);
+            key = string_view(body_.data() + j, i - j);
             j = i + 1;
             break;
         case '+':
             body_[i] = ' ';
             break;
         case '%':
+            if(i + 2 >= n) { break; }
             num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
             body_[i + 2] = num % 10 + '0';
             body_[i + 1] = num / 10 + '0';
             i += 2;
             break;
         case '&':
-            value = body_.substr(j, i - j);
+            post_.emplace_back(key, string_view(body_.data() + j, i - j));
+            LOG_DEBUG("%.*s = %.*s", (int)key.size(), key.data(), i - j, body_.data() + j);
             j = i + 1;
-            post_[key] = value;
-            LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
             break;
         default:
             break;
         }
     }
     assert(j <= i);
-    if(post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+    if(Find_(post_, key, false).empty() && j < i) {
+        post_.emplace_back(key, string_view(body_.data() + j, i - j));
     }
 }
 
@@ -247,16 +309,10 @@ std::string HttpRequest::version() const {
 
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
-    }
-    return "";
+    return std::string(Find_(post_, key, false));
 }
 
 std::string HttpRequest::GetPost(const char* key) const {
     assert(key != nullptr);
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
-    }
-    return "";
+    return std::string(Find_(post_, key, false));
 }
\ No newline at end of file
@@ -2,15 +2,17 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <string>
-#include <regex>
+#include <string_view>
 #include <errno.h>     
 #include <mysql/mysql.h>  //mysql
 
-#include "../buffer/buffer.h"
+#include "../buffer/buffer.hpp"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/arena.h"
 
 class HttpRequest {
 public:
@@ -36,7 +38,11 @@ public:
     ~HttpRequest() = default;
 
     void Init();
-    bool parse(Buffer& buff);
+
+    /* 增量解析: 数据不完整时返回NO_REQUEST, 已解析的部分保留, 下次从断点继续;
+       完整请求返回GET_REQUEST, 格式错误返回BAD_REQUEST.
+       上一个请求完成后再次调用会自动开始解析下一个请求 */
+    HTTP_CODE parse(Buffer& buff);
 
     std::string path() const;
     std::string& path();
@@ -45,6 +51,12 @@ public:
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
 
+    /* 头部名不区分大小写, 不存在时返回空; 视图在下一个请求开始前有效 */
+    std::string_view GetHeader(std::string_view key) const;
+
+    /* 连接关闭时归还arena的内存 */
+    void Release();
+
     bool IsKeepAlive() const;
 
     /* 
@@ -54,9 +66,9 @@ public:
     */
 
 private:
-    bool ParseRequestLine_(const std::string& line);
-    void ParseHeader_(const std::string& line);
-    void ParseBody_(const std::string& line);
+    bool ParseRequestLine_(std::string_view line);
+    bool ParseHeader_(std::string_view line);
+    void ParseBody_(std::string_view body);
 
     void ParsePath_();
     void ParsePost_();
@@ -64,10 +76,20 @@ private:
 
     static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
 
+    static const size_t MAX_LINE = 8192;        /* 请求行/单个头部的最大长度 */
+    static const size_t MAX_BODY = 1024 * 1024; /* Content-Length上限 */
+
     PARSE_STATE state_;
+    size_t scanned_;        /* 当前行已扫描过的字节数, 半行数据续读时不再从头找'\n' */
+    size_t contentLength_;
     std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
+    /* 头部和表单字段都是视图: 头部拷贝在arena_中, 表单字段指向body_, 每个请求开始时整体重置 */
+    typedef std::pair<std::string_view, std::string_view> Field;
+    Arena arena_;
+    std::vector<Field> header_;
+    std::vector<Field> post_;
+
+    static std::string_view Find_(const std::vector<Field>& fields, std::string_view key, bool ignoreCase);
 
     static const std::unordered_set<std::string> DEFAULT_HTML;
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
@@ -75,4 +97,3 @@ private:
 };
 
 
-#endif //HTTP_REQUEST_H
\ No newline at end of file
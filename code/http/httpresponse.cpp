@@ -31,6 +31,15 @@ const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 404, "Not Found" },
 };
 
+/* 状态行预先拼好, 生成响应时直接追加到写缓冲区 */
+const unordered_map<int, string> HttpResponse::STATUS_LINE = [] {
+    unordered_map<int, string> lines;
+    for(auto& item : CODE_STATUS) {
+        lines[item.first] = "HTTP/1.1 " + to_string(item.first) + " " + item.second + "\r\n";
+    }
+    return lines;
+}();
+
 const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 400, "/400.html" },
     { 403, "/403.html" },
@@ -41,32 +50,29 @@ HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
 };
 
 HttpResponse::~HttpResponse() {
-    UnmapFile();
+    CloseFile();
 }
 
 void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
     assert(srcDir != "");
-    if(mmFile_) { UnmapFile(); }
+    CloseFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
-    /* 判断请求的资源文件 */
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
+    /* 判断请求的资源文件, 命中缓存时不再stat/open */
+    int errCode = 0;
+    if(code_ == 400) {
+        /* 请求本身格式错误, 直接返回400页面 */
     }
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
-        code_ = 403;
+    else if(!(file_ = FileCache::Instance()->Get(FullPath_(), GetFileType_(), &errCode))) {
+        code_ = errCode;
     }
     else if(code_ == -1) { 
         code_ = 200; 
@@ -77,99 +83,93 @@ void HttpResponse::MakeResponse(Buffer& buff) {
     AddContent_(buff);
 }
 
-char* HttpResponse::File() {
-    return mmFile_;
-}
-
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    return file_ ? file_->size : 0;
 }
 
 void HttpResponse::ErrorHtml_() {
     if(CODE_PATH.count(code_) == 1) {
         path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+        int errCode = 0;
+        file_ = FileCache::Instance()->Get(FullPath_(), GetFileType_(), &errCode);
     }
 }
 
+const string& HttpResponse::FullPath_() {
+    /* 复用fullPath_的容量, 稳定后不再分配 */
+    fullPath_.assign(srcDir_).append(path_);
+    return fullPath_;
+}
+
 void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+    auto it = STATUS_LINE.find(code_);
+    if(it == STATUS_LINE.end()) {
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        it = STATUS_LINE.find(400);
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    buff.Append(it->second);
 }
 
 void HttpResponse::AddHeader_(Buffer& buff) {
-    buff.Append("Connection: ");
+    static const char KEEP_ALIVE[] = "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n";
+    static const char CLOSE[] = "Connection: close\r\n";
     if(isKeepAlive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+        buff.Append(KEEP_ALIVE, sizeof(KEEP_ALIVE) - 1);
     } else{
-        buff.Append("close\r\n");
+        buff.Append(CLOSE, sizeof(CLOSE) - 1);
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) { 
+    if(!file_) { 
+        buff.Append("Content-type: ", 14);
+        buff.Append(GetFileType_());
+        buff.Append("\r\n", 2);
         ErrorContent(buff, "File NotFound!");
         return; 
     }
 
-    /* 将文件映射到内存提高文件的访问速度 
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
-        return; 
-    }
-    mmFile_ = (char*)mmRet;
-    close(srcFd);
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    /* Content-type/Content-length/Last-Modified/ETag 已在缓存中生成好,
+       正文由HttpConn发送: 小文件用缓存的内容, 大文件用sendfile */
+    LOG_DEBUG("file path %s%s", srcDir_.data(), path_.data());
+    buff.Append(file_->headers);
+    buff.Append("\r\n", 2);
 }
 
-void HttpResponse::UnmapFile() {
-    if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
-    }
+void HttpResponse::CloseFile() {
+    file_.reset();
 }
 
-string HttpResponse::GetFileType_() {
+const string& HttpResponse::GetFileType_() {
     /* 判断文件类型 */
+    static const string PLAIN = "text/plain";
     string::size_type idx = path_.find_last_of('.');
     if(idx == string::npos) {
-        return "text/plain";
+        return PLAIN;
     }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    /* 后缀都很短, 走SSO不会分配 */
+    auto it = SUFFIX_TYPE.find(path_.substr(idx));
+    if(it != SUFFIX_TYPE.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return PLAIN;
 }
 
-void HttpResponse::ErrorContent(Buffer& buff, string message) 
+void HttpResponse::ErrorContent(Buffer& buff, const string& message) 
 {
-    string body;
-    string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
-        status = "Bad Request";
-    }
-    body += to_string(code_) + " : " + status  + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>TinyWebServer</em></body></html>";
-
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+    auto it = CODE_STATUS.find(code_);
+    const char* status = (it != CODE_STATUS.end()) ? it->second.c_str() : "Bad Request";
+
+    /* 正文先格式化到栈上, 头部和正文直接写进缓冲区 */
+    char body[1024];
+    int len = snprintf(body, sizeof(body),
+                       "<html><title>Error</title><body bgcolor=\"ffffff\">%d : %s\n"
+                       "<p>%s</p><hr><em>TinyWebServer</em></body></html>",
+                       code_, status, message.c_str());
+    len = std::min(len, static_cast<int>(sizeof(body)) - 1);
+
+    char head[64];
+    int headLen = snprintf(head, sizeof(head), "Content-length: %d\r\n\r\n", len);
+    buff.Append(head, headLen);
+    buff.Append(body, len);
 }
@@ -1,13 +1,10 @@
 #pragma once
 
 #include <unordered_map>
-#include <fcntl.h>       // open
-#include <unistd.h>      // close
-#include <sys/stat.h>    // stat
-#include <sys/mman.h>    // mmap, munmap
 
-#include "../buffer/buffer.h"
+#include "../buffer/buffer.hpp"
 #include "../log/log.h"
+#include "filecache.h"
 
 class HttpResponse {
 public:
@@ -16,10 +13,10 @@ public:
 
     void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
     void MakeResponse(Buffer& buff);
-    void UnmapFile();
-    char* File();
+    void CloseFile();
+    FileCache::EntryPtr File() const { return file_; }
     size_t FileLen() const;
-    void ErrorContent(Buffer& buff, std::string message);
+    void ErrorContent(Buffer& buff, const std::string& message);
     int Code() const { return code_; }
 
 private:
@@ -28,18 +25,20 @@ private:
     void AddContent_(Buffer &buff);
 
     void ErrorHtml_();
-    std::string GetFileType_();
+    const std::string& GetFileType_();
+    const std::string& FullPath_();
 
     int code_;
     bool isKeepAlive_;
 
     std::string path_;
     std::string srcDir_;
+    std::string fullPath_;
     
-    char* mmFile_; 
-    struct stat mmFileStat_;
+    FileCache::EntryPtr file_;  /* 缓存中的文件, 连接发送完之前保持引用 */
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
     static const std::unordered_map<int, std::string> CODE_STATUS;
+    static const std::unordered_map<int, std::string> STATUS_LINE;
     static const std::unordered_map<int, std::string> CODE_PATH;
 };
\ No newline at end of file
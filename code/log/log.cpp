@@ -1,180 +1,230 @@
 #include "log.h"
 
+#include <vector>
+#include <chrono>
+
 using namespace std;
 
 Log::Log() {
     lineCount_ = 0;
+    fileLines_ = 0;
+    isOpen_ = false;
+    level_ = 1;
     isAsync_ = false;
+    syncFallbacks_ = 0;
     writeThread_ = nullptr;
-    deque_ = nullptr;
+    queue_ = nullptr;
     toDay_ = 0;
     fp_ = nullptr;
+    waiting_ = false;
+    stop_ = false;
 }
 
 Log::~Log() {
     if(writeThread_ && writeThread_->joinable()) {
-        while(!deque_->empty()) {
-            deque_->flush();
-        };
-        deque_->Close();
+        /* 写线程退出前会把队列里剩下的日志写完 */
+        {
+            lock_guard<mutex> locker(waitMtx_);
+            stop_ = true;
+        }
+        cond_.notify_one();
         writeThread_->join();
     }
     if(fp_) {
         lock_guard<mutex> locker(mtx_);
-        flush();
+        fflush(fp_);
         fclose(fp_);
     }
 }
 
-int Log::GetLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
-}
-
 void Log::SetLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+    level_.store(level, memory_order_relaxed);
 }
 
 void Log::init(int level = 1, const char* path, const char* suffix,
     int maxQueueSize) {
-    isOpen_ = true;
     level_ = level;
     if(maxQueueSize > 0) {
-        isAsync_ = true;
-        if(!deque_) {
-            unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
-            deque_ = move(newDeque);
-            
-            std::unique_ptr<std::thread> NewThread(new thread(FlushLogThread));
-            writeThread_ = move(NewThread);
+        if(!queue_) {
+            queue_.reset(new MpscQueue<std::string>(maxQueueSize));
+            writeThread_.reset(new thread(FlushLogThread));
         }
+        isAsync_ = true;
     } else {
         isAsync_ = false;
     }
 
-    lineCount_ = 0;
-
     time_t timer = time(nullptr);
-    struct tm *sysTime = localtime(&timer);
-    struct tm t = *sysTime;
+    struct tm t;
+    localtime_r(&timer, &t);
     path_ = path;
     suffix_ = suffix;
     char fileName[LOG_NAME_LEN] = {0};
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
+    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s",
             path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-    toDay_ = t.tm_mday;
 
     {
         lock_guard<mutex> locker(mtx_);
-        buff_.RetrieveAll();
-        if(fp_) { 
-            flush();
-            fclose(fp_); 
+        lineCount_ = 0;
+        fileLines_ = 0;
+        toDay_ = t.tm_mday;
+        if(fp_) {
+            fflush(fp_);
+            fclose(fp_);
         }
 
         fp_ = fopen(fileName, "a");
         if(fp_ == nullptr) {
             mkdir(path_, 0777);
             fp_ = fopen(fileName, "a");
-        } 
+        }
         assert(fp_ != nullptr);
     }
+    isOpen_.store(true, memory_order_release);
+}
+
+size_t Log::FormatPrefix_(char* buf, int level, const struct timeval& now) {
+    /* localtime_r和日期格式化每个线程每秒只做一次 */
+    thread_local time_t cachedSec = -1;
+    thread_local char cachedTime[32];
+    thread_local size_t cachedLen = 0;
+    if(now.tv_sec != cachedSec) {
+        struct tm t;
+        localtime_r(&now.tv_sec, &t);
+        cachedLen = snprintf(cachedTime, sizeof(cachedTime), "%d-%02d-%02d %02d:%02d:%02d.",
+                             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                             t.tm_hour, t.tm_min, t.tm_sec);
+        cachedSec = now.tv_sec;
+    }
+
+    static const char* TITLE[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+    const char* title = (level >= 0 && level <= 3) ? TITLE[level] : TITLE[1];
+
+    memcpy(buf, cachedTime, cachedLen);
+    size_t len = cachedLen;
+    len += snprintf(buf + len, 16, "%06ld ", static_cast<long>(now.tv_usec));
+    memcpy(buf + len, title, 9);
+    return len + 9;
 }
 
 void Log::write(int level, const char *format, ...) {
     struct timeval now = {0, 0};
     gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
-    va_list vaList;
 
-    /* 日志日期 日志行数 */
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
-    {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if (toDay_ != t.tm_mday)
-        {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
-        }
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
+    /* 在调用线程自己的缓冲区里格式化, 不加锁 */
+    thread_local vector<char> buf(1024);
+    size_t len = FormatPrefix_(buf.data(), level, now);
+
+    va_list vaList;
+    va_start(vaList, format);
+    va_list vaCopy;
+    va_copy(vaCopy, vaList);
+    int m = vsnprintf(buf.data() + len, buf.size() - len, format, vaList);
+    if(m >= 0 && static_cast<size_t>(m) + 1 >= buf.size() - len) {
+        /* 放不下时扩容后重新格式化 */
+        buf.resize(len + m + 2);
+        m = vsnprintf(buf.data() + len, buf.size() - len, format, vaCopy);
+    }
+    va_end(vaCopy);
+    va_end(vaList);
+    if(m > 0) { len += m; }
+    buf[len++] = '\n';
+
+    if(isAsync_.load(memory_order_relaxed)) {
+        const char* data = buf.data();
+        bool pushed = queue_->TryPush([data, len](string& slot) { slot.assign(data, len); });
+        if(pushed) {
+            atomic_thread_fence(memory_order_seq_cst);
+            if(waiting_.load()) {
+                /* 写线程在休眠时才需要加锁唤醒 */
+                lock_guard<mutex> locker(waitMtx_);
+                cond_.notify_one();
+            }
+            return;
         }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+        /* 队列满, 退化为同步写 */
+        syncFallbacks_.fetch_add(1, memory_order_relaxed);
+    }
+
+    lock_guard<mutex> locker(mtx_);
+    WriteLines_(buf.data(), len, 1);
+    if(!isAsync_) { fflush(fp_); }
+}
+
+void Log::RotateIfNeeded_() {
+    /* 持有mtx_时调用. 按日期或行数切换日志文件 */
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    if(toDay_ == t.tm_mday && fileLines_ < MAX_LINES) {
+        return;
     }
 
+    char newFile[LOG_NAME_LEN];
+    char tail[36] = {0};
+    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+
+    if (toDay_ != t.tm_mday)
     {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-                    
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);
-
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
-
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
-
-        if(isAsync_ && deque_ && !deque_->full()) {
-            deque_->push_back(buff_.RetrieveAllToStr());
-        } else {
-            fputs(buff_.Peek(), fp_);
-        }
-        buff_.RetrieveAll();
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+        toDay_ = t.tm_mday;
+        lineCount_ = 0;
+    }
+    else {
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
     }
+    fileLines_ = 0;
+
+    fflush(fp_);
+    fclose(fp_);
+    fp_ = fopen(newFile, "a");
+    assert(fp_ != nullptr);
 }
 
-void Log::AppendLogLevelTitle_(int level) {
-    switch(level) {
-    case 0:
-        buff_.Append("[debug]: ", 9);
-        break;
-    case 1:
-        buff_.Append("[info] : ", 9);
-        break;
-    case 2:
-        buff_.Append("[warn] : ", 9);
-        break;
-    case 3:
-        buff_.Append("[error]: ", 9);
-        break;
-    default:
-        buff_.Append("[info] : ", 9);
-        break;
-    }
+void Log::WriteLines_(const char* data, size_t len, int lines) {
+    /* 持有mtx_时调用 */
+    RotateIfNeeded_();
+    fwrite(data, 1, len, fp_);
+    lineCount_ += lines;
+    fileLines_ += lines;
 }
 
 void Log::flush() {
-    if(isAsync_) { 
-        deque_->flush(); 
+    if(isAsync_) {
+        /* 让写线程尽快把队列写出去 */
+        lock_guard<mutex> locker(waitMtx_);
+        cond_.notify_one();
     }
-    fflush(fp_);
+    lock_guard<mutex> locker(mtx_);
+    if(fp_) { fflush(fp_); }
 }
 
 void Log::AsyncWrite_() {
-    string str = "";
-    while(deque_->pop(str)) {
-        lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+    string batch;
+    batch.reserve(BATCH_BYTES);
+    while(true) {
+        int lines = 0;
+        while(batch.size() < BATCH_BYTES &&
+              queue_->TryPop([&batch](string& line) { batch.append(line); })) {
+            lines++;
+        }
+        if(lines > 0) {
+            lock_guard<mutex> locker(mtx_);
+            WriteLines_(batch.data(), batch.size(), lines);
+            batch.clear();
+            /* 队列写空了才刷盘, 高负载时不会每行一次fflush */
+            if(queue_->Empty()) { fflush(fp_); }
+            continue;
+        }
+
+        unique_lock<mutex> locker(waitMtx_);
+        if(stop_) { break; }
+        waiting_ = true;
+        atomic_thread_fence(memory_order_seq_cst);
+        if(queue_->Empty()) {
+            cond_.wait_for(locker, chrono::milliseconds(100));
+        }
+        waiting_ = false;
     }
 }
 
@@ -185,4 +235,4 @@ Log* Log::Instance() {
 
 void Log::FlushLogThread() {
     Log::Instance()->AsyncWrite_();
-}
\ No newline at end of file
+}
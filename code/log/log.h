@@ -1,8 +1,10 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
 #include <string>
 #include <thread>
+#include <condition_variable>
 #include <sys/time.h>
 #include <string.h>
 #include <stdarg.h>           // vastart va_end
@@ -10,12 +12,17 @@
 #include <assert.h>
 
 #include <sys/stat.h>         //mkdir
+#include <unistd.h>
 
-#include "blockqueue.h"
-#include "../buffer/buffer.hpp"
+#include "mpscqueue.h"
 
+// 异步模式：
+// 调用线程在自己的线程局部缓冲区里格式化(时间前缀按秒缓存)，然后放进无锁MPSC队列，不持有任何锁；
+// 写线程成批取出，一批只调用一次fwrite，队列空时才fflush，按行数/日期切换文件也只在写线程里做。
+// 队列满时退化为同步写。日志等级是原子变量，LOG_BASE判断等级不加锁。
 class Log {
 public:
+    /* 队列和写线程只在第一次以异步方式init时创建, 再次init不会改变队列容量 */
     void init(int level, const char* path = "./log", 
                 const char* suffix =".log",
                 int maxQueueCapacity = 1024);
@@ -26,39 +33,53 @@ public:
     void write(int level, const char *format,...);
     void flush();
 
-    int GetLevel();
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
     void SetLevel(int level);
-    bool IsOpen() { return isOpen_; }
+    bool IsOpen() const { return isOpen_.load(std::memory_order_acquire); }
+    /* 异步模式下因队列满而同步写的行数 */
+    uint64_t SyncFallbacks() const { return syncFallbacks_.load(std::memory_order_relaxed); }
     
 private:
     Log();
-    void AppendLogLevelTitle_(int level);
     virtual ~Log();
     void AsyncWrite_();
+    void WriteLines_(const char* data, size_t len, int lines);
+    void RotateIfNeeded_();
+
+    /* 时间前缀+等级, 返回写入的长度 */
+    static size_t FormatPrefix_(char* buf, int level, const struct timeval& now);
 
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
     static const int MAX_LINES = 50000;
+    static const size_t BATCH_BYTES = 64 * 1024;  /* 写线程一次fwrite的最大字节数 */
 
     const char* path_;
     const char* suffix_;
 
     int MAX_LINES_;
 
-    int lineCount_;
+    int lineCount_;   /* 当天的行数 */
+    int fileLines_;   /* 当前文件的行数, 写线程成批写入时可能略超过MAX_LINES */
     int toDay_;
 
-    bool isOpen_;
+    std::atomic<bool> isOpen_;
  
-    Buffer buff_;
-    int level_;
-    bool isAsync_;
+    std::atomic<int> level_;
+    std::atomic<bool> isAsync_;
+    std::atomic<uint64_t> syncFallbacks_;
 
     FILE* fp_;
-    std::unique_ptr<BlockDeque<std::string>> deque_; 
+    std::unique_ptr<MpscQueue<std::string>> queue_; 
     std::unique_ptr<std::thread> writeThread_;
-    std::mutex mtx_;
+    std::mutex mtx_;          /* 保护fp_、lineCount_和文件切换 */
+
+    /* 写线程空闲时在cond_上等待, 生产者只在waiting_为true时才加锁唤醒 */
+    std::mutex waitMtx_;
+    std::condition_variable cond_;
+    std::atomic<bool> waiting_;
+    std::atomic<bool> stop_;
 };
 
 #define LOG_BASE(level, format, ...) \
@@ -66,7 +87,6 @@ private:
         Log* log = Log::Instance();\
         if (log->IsOpen() && log->GetLevel() <= level) {\
             log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
         }\
     } while(0);
 
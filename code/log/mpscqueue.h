@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/* 有界的多生产者单消费者无锁队列(Dmitry Vyukov的bounded queue):
+   每个槽带一个序号, 生产者用CAS抢占写入位置, 写完后发布序号; 消费者只有一个, 不需要CAS.
+   槽里的对象一直复用, T为std::string时容量保留下来, 稳定后入队不再分配内存.
+   队列满时TryPush返回false, 由调用者决定丢弃还是同步写. */
+template<class T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity) {
+        size_t size = 2;
+        while(size < capacity) { size <<= 1; }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for(size_t i = 0; i < size; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        tail_.store(0, std::memory_order_relaxed);
+        head_ = 0;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /* fill(T&)在抢到的槽上原地填充数据 */
+    template<class F>
+    bool TryPush(F&& fill) {
+        Cell* cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0) {
+                if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            }
+            else if(diff < 0) {
+                return false; /* 满 */
+            }
+            else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        fill(cell->data);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* 只能由唯一的消费者线程调用, consume(T&)处理队头元素 */
+    template<class F>
+    bool TryPop(F&& consume) {
+        Cell* cell = &cells_[head_ & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        if(static_cast<intptr_t>(seq) - static_cast<intptr_t>(head_ + 1) < 0) {
+            return false; /* 空, 或生产者还没写完 */
+        }
+        consume(cell->data);
+        cell->seq.store(head_ + mask_ + 1, std::memory_order_release);
+        head_++;
+        return true;
+    }
+
+    /* 近似值, 只用于消费者决定是否休眠 */
+    bool Empty() const {
+        return tail_.load(std::memory_order_acquire) == head_;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> tail_;  /* 生产者共享 */
+    alignas(64) size_t head_;               /* 只有消费者访问 */
+};
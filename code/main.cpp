@@ -8,6 +8,7 @@ int main()
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "root", "webserver", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 IO线程(sub reactor)数量 日志开关 日志等级 日志异步队列容量 */
+        false);                            /* true: 每个loop一个SO_REUSEPORT监听socket, 不再经过main reactor */
     server.Start();
 } 
\ No newline at end of file
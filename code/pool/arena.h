@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <string_view>
+#include <assert.h>
+
+/* 每个连接独占的线性分配器(arena):
+   一个请求解析过程中的小对象(头部名/值、表单字段)从块里顺序切出来, 不单独释放;
+   请求结束时Reset()整体回收, 只保留第一个块供下一个请求复用, 稳定后每个请求不再有堆分配.
+   不是线程安全的, 只在连接所在的loop线程中使用. */
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 2048) : blockSize_(blockSize), used_(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    char* Allocate(size_t len) {
+        if(blocks_.empty() || used_ + len > CurrentSize_()) {
+            NewBlock_(len);
+        }
+        char* ptr = blocks_.back().data.get() + used_;
+        used_ += len;
+        return ptr;
+    }
+
+    /* 把s拷进arena, 返回指向arena内部的视图 */
+    std::string_view Copy(std::string_view s) {
+        if(s.empty()) { return std::string_view(); }
+        char* ptr = Allocate(s.size());
+        memcpy(ptr, s.data(), s.size());
+        return std::string_view(ptr, s.size());
+    }
+
+    /* 回收所有分配, 保留第一个块 */
+    void Reset() {
+        if(!blocks_.empty() && blocks_.front().size != blockSize_) {
+            blocks_.clear();
+        }
+        else if(blocks_.size() > 1) {
+            blocks_.resize(1);
+        }
+        used_ = 0;
+    }
+
+    /* 归还全部内存(连接关闭时) */
+    void Release() {
+        blocks_.clear();
+        used_ = 0;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t CurrentSize_() const {
+        return blocks_.back().size;
+    }
+
+    void NewBlock_(size_t len) {
+        /* 超过块大小的分配单独占一个块 */
+        size_t size = len > blockSize_ ? len : blockSize_;
+        blocks_.push_back({ std::unique_ptr<char[]>(new char[size]), size });
+        used_ = 0;
+    }
+
+    size_t blockSize_;
+    size_t used_;      /* 当前(最后一个)块已用字节数 */
+    std::vector<Block> blocks_;
+};
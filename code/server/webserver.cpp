@@ -6,9 +6,10 @@ WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
+            bool openLog, int logLevel, int logQueSize, bool reusePort):
             port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new timer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            threadNum_(threadNum), reusePort_(reusePort),
+            baseLoop_(new eventLoop()), nextLoop_(0)
     {
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
@@ -18,7 +19,22 @@ WebServer::WebServer(
     SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
 
     InitEventMode_(trigMode);
-    if(!InitSocket_()) { isClose_ = true;}
+    if(port_ > 65535 || port_ < 1024) {
+        LOG_ERROR("Port:%d error!",  port_);
+        isClose_ = true;
+    }
+    else if(!reusePort_) {
+        /* 主reactor的监听socket在构造时创建, 端口占用等错误能立即发现 */
+        try {
+            acceptor_.reset(new Acceptor(baseLoop_.get(), InetAddress(port_)));
+            acceptor_->setLinger(openLinger_);
+            acceptor_->setNewConnectionCallback(
+                std::bind(&WebServer::NewConnection_, this, std::placeholders::_1, std::placeholders::_2));
+        } catch(const std::exception& e) {
+            LOG_ERROR("Create acceptor error: %s", e.what());
+            isClose_ = true;
+        }
+    }
 
     if(openLog) {
         Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
@@ -26,42 +42,42 @@ WebServer::WebServer(
         else {
             LOG_INFO("========== Server init ==========");
             LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger? "true":"false");
-            LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
-                            (listenEvent_ & EPOLLET ? "ET": "LT"),
-                            (connEvent_ & EPOLLET ? "ET": "LT"));
+            LOG_INFO("OpenConn Mode: %s", (connEvent_ & EPOLLET ? "ET": "LT"));
             LOG_INFO("LogSys level: %d", logLevel);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("SqlConnPool num: %d, IO loop num: %d", connPoolNum, threadNum);
+            LOG_INFO("Reactor mode: %s", reusePort_ ? "SO_REUSEPORT per loop" : "main/sub reactor");
         }
     }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);
+    /* 先停掉所有loop线程再释放它们的连接 */
+    loopPool_.reset();
+    for(auto& ctx : loopCtxs_) {
+        for(auto& item : ctx->channels) {
+            item.second->set_fd(-1); /* fd由HttpConn关闭 */
+        }
+    }
+    loopCtxs_.clear();
+    acceptor_.reset();
     isClose_ = true;
     free(srcDir_);
     SqlConnPool::Instance()->ClosePool();
 }
 
 void WebServer::InitEventMode_(int trigMode) {
-    listenEvent_ = EPOLLRDHUP;
-    connEvent_ = EPOLLONESHOT | EPOLLRDHUP;
+    /* 监听socket固定为ET并一次accept到EAGAIN, 这里只决定连接的触发模式 */
+    /* 每个连接只属于一个loop线程, 不需要EPOLLONESHOT */
+    connEvent_ = EPOLLRDHUP;
     switch (trigMode)
     {
     case 0:
-        break;
-    case 1:
-        connEvent_ |= EPOLLET;
-        break;
     case 2:
-        listenEvent_ |= EPOLLET;
         break;
+    case 1:
     case 3:
-        listenEvent_ |= EPOLLET;
-        connEvent_ |= EPOLLET;
-        break;
     default:
-        listenEvent_ |= EPOLLET;
         connEvent_ |= EPOLLET;
         break;
     }
@@ -69,36 +85,86 @@ void WebServer::InitEventMode_(int trigMode) {
 }
 
 void WebServer::Start() {
-    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
-    if(!isClose_) { LOG_INFO("========== Server start =========="); }
-    while(!isClose_) {
-        if(timeoutMS_ > 0) {
-            timeMS = timer_->getNextTick();
+    if(isClose_) { return; }
+    LOG_INFO("========== Server start ==========");
+    InitLoops_();
+    baseLoop_->loop();
+}
+
+void WebServer::InitLoops_() {
+    std::vector<eventLoop*> loops;
+    if(reusePort_) {
+        /* baseLoop也是一个IO loop, 另起 threadNum_-1 个loop线程 */
+        int num = std::max(threadNum_, 1);
+        loopPool_.reset(new eventLoopThreadPool(baseLoop_.get(), num - 1));
+        loopPool_->start();
+        loops = loopPool_->getAllLoops();
+        if(num > 1) { loops.push_back(baseLoop_.get()); }
+    } else {
+        /* threadNum_为0时getAllLoops只返回baseLoop */
+        loopPool_.reset(new eventLoopThreadPool(baseLoop_.get(), threadNum_));
+        loopPool_->start();
+        loops = loopPool_->getAllLoops();
+    }
+
+    for(eventLoop* loop : loops) {
+        loopCtxs_.emplace_back(new LoopContext());
+        LoopContext* ctx = loopCtxs_.back().get();
+        ctx->loop = loop;
+        if(reusePort_) {
+            loop->runInLoop([this, ctx]() { ListenInLoop_(ctx); });
         }
-        int eventCnt = epoller_->Wait(timeMS);
-        for(int i = 0; i < eventCnt; i++) {
-            /* 处理事件 */
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
-            if(fd == listenFd_) {
-                DealListen_();
-            }
-            else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
-            }
-            else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
-            }
-            else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
-            } else {
-                LOG_ERROR("Unexpected event");
+    }
+    if(acceptor_) {
+        acceptor_->listen();
+    }
+}
+
+void WebServer::ListenInLoop_(LoopContext* ctx) {
+    try {
+        ctx->acceptor.reset(new Acceptor(ctx->loop, InetAddress(port_), true));
+        ctx->acceptor->setLinger(openLinger_);
+        /* 本loop accept到的连接直接留在本loop */
+        ctx->acceptor->setNewConnectionCallback([this, ctx](int fd, const InetAddress& peerAddr) {
+            if(HttpConn::userCount >= MAX_FD) {
+                SendError_(fd, "Server busy!");
+                LOG_WARN("Clients is full!");
+                return;
             }
+            ctx->connCount++;
+            AddClient_(ctx, fd, peerAddr.get_sockaddr_in());
+        });
+        ctx->acceptor->listen();
+    } catch(const std::exception& e) {
+        LOG_ERROR("Loop listen init error: %s", e.what());
+    }
+}
+
+void WebServer::NewConnection_(int fd, const InetAddress& peerAddr) {
+    if(HttpConn::userCount >= MAX_FD) {
+        SendError_(fd, "Server busy!");
+        LOG_WARN("Clients is full!");
+        return;
+    }
+    LoopContext* ctx = NextLoop_();
+    ctx->connCount++;
+    sockaddr_in addr = peerAddr.get_sockaddr_in();
+    /* 连接交给sub reactor后只在它的线程里访问 */
+    ctx->loop->queueInLoop([this, ctx, fd, addr]() { AddClient_(ctx, fd, addr); });
+}
+
+WebServer::LoopContext* WebServer::NextLoop_() {
+    /* 从轮询位置开始找连接数最少的loop, 负载相同时退化为round-robin */
+    size_t n = loopCtxs_.size();
+    size_t best = nextLoop_ % n;
+    for(size_t i = 1; i < n; i++) {
+        size_t idx = (nextLoop_ + i) % n;
+        if(loopCtxs_[idx]->connCount < loopCtxs_[best]->connCount) {
+            best = idx;
         }
     }
+    nextLoop_ = best + 1;
+    return loopCtxs_[best].get();
 }
 
 void WebServer::SendError_(int fd, const char*info) {
@@ -110,166 +176,96 @@ void WebServer::SendError_(int fd, const char*info) {
     close(fd);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {
-    assert(client);
-    LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
-    client->Close();
-}
-
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
+void WebServer::AddClient_(LoopContext* ctx, int fd, sockaddr_in addr) {
     assert(fd > 0);
-    users_[fd].init(fd, addr);
-    if(timeoutMS_ > 0) {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
-    }
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
-}
+    ctx->users[fd].init(fd, addr);
 
-void WebServer::DealListen_() {
-    struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-    do {
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
-        if(fd <= 0) { return;}
-        else if(HttpConn::userCount >= MAX_FD) {
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
-            return;
-        }
-        AddClient_(fd, addr);
-    } while(listenEvent_ & EPOLLET);
-}
+    std::shared_ptr<channel> ch = std::make_shared<channel>(fd);
+    channel* raw = ch.get();
+    ch->set_events(EPOLLIN | connEvent_);
+    ch->set_read_callback([this, ctx, fd, raw]() { OnRead_(ctx, fd, raw); });
+    ch->set_write_callback([this, ctx, fd, raw]() { OnWrite_(ctx, fd, raw); });
+    ch->set_error_handler([this, ctx, fd, raw]() { CloseConn_(ctx, fd, raw, true); });
+    ctx->channels[fd] = ch;
+    ctx->loop->epollerAdd(ch);
 
-void WebServer::DealRead_(HttpConn* client) {
-    assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    if(timeoutMS_ > 0) {
+        ctx->loop->addTimer(fd, timeoutMS_, [this, ctx, fd, raw]() { CloseConn_(ctx, fd, raw, false); });
+    }
 }
 
-void WebServer::DealWrite_(HttpConn* client) {
-    assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+bool WebServer::IsActive_(const LoopContext* ctx, int fd, const channel* ch) {
+    /* 同一轮事件中fd可能已被关闭并复用, 用channel地址区分 */
+    auto it = ctx->channels.find(fd);
+    return it != ctx->channels.end() && it->second.get() == ch;
 }
 
-void WebServer::ExtentTime_(HttpConn* client) {
-    assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
-}
+void WebServer::OnRead_(LoopContext* ctx, int fd, channel* ch) {
+    if(!IsActive_(ctx, fd, ch)) { return; }
+    HttpConn* client = &ctx->users[fd];
+    if(timeoutMS_ > 0) { ctx->loop->adjustTimer(fd, timeoutMS_); }
 
-void WebServer::OnRead_(HttpConn* client) {
-    assert(client);
-    int ret = -1;
     int readErrno = 0;
-    ret = client->read(&readErrno);
+    ssize_t ret = client->read(&readErrno);
     if(ret <= 0 && readErrno != EAGAIN) {
-        CloseConn_(client);
+        CloseConn_(ctx, fd, ch, true);
         return;
     }
-    OnProcess(client);
+    OnProcess_(ctx, fd, ch);
 }
 
-void WebServer::OnProcess(HttpConn* client) {
-    if(client->process()) {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+void WebServer::OnProcess_(LoopContext* ctx, int fd, channel* ch) {
+    if(ctx->users[fd].process()) {
+        /* 在loop线程直接写, 写不完再关注EPOLLOUT */
+        OnWrite_(ctx, fd, ch);
     } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        UpdateEvents_(ctx, ch, connEvent_ | EPOLLIN);
     }
 }
 
-void WebServer::OnWrite_(HttpConn* client) {
-    assert(client);
-    int ret = -1;
+void WebServer::OnWrite_(LoopContext* ctx, int fd, channel* ch) {
+    if(!IsActive_(ctx, fd, ch)) { return; }
+    HttpConn* client = &ctx->users[fd];
+    if(timeoutMS_ > 0) { ctx->loop->adjustTimer(fd, timeoutMS_); }
+
     int writeErrno = 0;
-    ret = client->write(&writeErrno);
+    ssize_t ret = client->write(&writeErrno);
     if(client->ToWriteBytes() == 0) {
         /* 传输完成 */
         if(client->IsKeepAlive()) {
-            OnProcess(client);
+            OnProcess_(ctx, fd, ch);
             return;
         }
     }
     else if(ret < 0) {
         if(writeErrno == EAGAIN) {
             /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            UpdateEvents_(ctx, ch, connEvent_ | EPOLLOUT);
             return;
         }
     }
-    CloseConn_(client);
+    CloseConn_(ctx, fd, ch, true);
 }
 
-/* Create listenFd */
-bool WebServer::InitSocket_() {
-    int ret;
-    struct sockaddr_in addr;
-    if(port_ > 65535 || port_ < 1024) {
-        LOG_ERROR("Port:%d error!",  port_);
-        return false;
-    }
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port_);
-    struct linger optLinger = { 0 };
-    if(openLinger_) {
-        /* 优雅关闭: 直到所剩数据发送完毕或超时 */
-        optLinger.l_onoff = 1;
-        optLinger.l_linger = 1;
-    }
-
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if(listenFd_ < 0) {
-        LOG_ERROR("Create socket error!", port_);
-        return false;
-    }
-
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
-    if(ret < 0) {
-        close(listenFd_);
-        LOG_ERROR("Init linger error!", port_);
-        return false;
-    }
-
-    int optval = 1;
-    /* 端口复用 */
-    /* 只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
-    if(ret == -1) {
-        LOG_ERROR("set socket setsockopt error !");
-        close(listenFd_);
-        return false;
-    }
-
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
-    if(ret < 0) {
-        LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
-        return false;
-    }
-
-    ret = listen(listenFd_, 6);
-    if(ret < 0) {
-        LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
-        return false;
-    }
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
-    if(ret == 0) {
-        LOG_ERROR("Add listen error!");
-        close(listenFd_);
-        return false;
-    }
-    SetFdNonblock(listenFd_);
-    LOG_INFO("Server port:%d", port_);
-    return true;
+void WebServer::UpdateEvents_(LoopContext* ctx, channel* ch, uint32_t events) {
+    /* 事件不变时省掉一次epoll_ctl */
+    if(ch->get_events() == events) { return; }
+    ch->set_events(events);
+    ctx->loop->epollerMod(ctx->channels[ch->get_fd()]);
 }
 
-int WebServer::SetFdNonblock(int fd) {
-    assert(fd > 0);
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
-}
+void WebServer::CloseConn_(LoopContext* ctx, int fd, channel* ch, bool cancelTimer) {
+    if(!IsActive_(ctx, fd, ch)) { return; }
+    std::shared_ptr<channel> conn = std::move(ctx->channels[fd]);
+    ctx->channels.erase(fd);
 
+    LOG_INFO("Client[%d] quit!", fd);
+    ctx->loop->epollerDel(conn);
+    if(cancelTimer && timeoutMS_ > 0) { ctx->loop->cancelTimer(fd); }
+    conn->set_fd(-1); /* fd由HttpConn关闭 */
+    ctx->users[fd].Close();
+    ctx->connCount--;
 
+    /* 当前可能正在执行该channel的回调, 推迟到本轮事件处理完再析构 */
+    ctx->loop->queueInLoop([conn]() {});
+}
@@ -1,65 +1,80 @@
 #pragma once //防止头文件被重复包含
 
 #include <unordered_map> //无序字典容器头文件
+#include <atomic>
 
 //是POSIX（可移植操作系统接口）标准的一部分，主要在UNIX/Linux系统上可用
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include "epoller.h"
+#include "../eventLoop/eventLoop.hpp"
+#include "../eventLoop/eventLoopThread.hpp"
+#include "../acceptor/acceptor.hpp"
 #include "../log/log.h"
-#include "../timer/timer.hpp"
 #include "../pool/sqlconnpool.h"
-#include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
 #include "../http/httpconn.h"
 
+// 主从Reactor：
+// main reactor(baseLoop_)上的Acceptor负责accept，按负载把连接fd通过queueInLoop交给sub reactor
+// 每个sub reactor独占自己的epoller、定时器和连接，读、解析、写都在loop线程内完成
+// reusePort模式下不再区分主从，每个loop各有一个SO_REUSEPORT的Acceptor，由内核分发连接
 class WebServer
 {
 public:
     WebServer(
-        int port, int trigMode, int timeoutMS, bool OptLinger, 
-        int sqlPort, const char* sqlUser, const  char* sqlPwd, 
+        int port, int trigMode, int timeoutMS, bool OptLinger,
+        int sqlPort, const char* sqlUser, const  char* sqlPwd,
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize,
+        bool reusePort = false);
 
     ~WebServer();
     void Start();
 
 private:
-    bool InitSocket_(); 
+    /* 每个eventLoop独占的连接，只在该loop线程中访问 */
+    struct LoopContext {
+        eventLoop* loop = nullptr;
+        std::unique_ptr<Acceptor> acceptor;            /* 仅reusePort模式 */
+        std::atomic<int> connCount{0};                 /* 主reactor据此选择最空闲的loop */
+        std::unordered_map<int, HttpConn> users;
+        std::unordered_map<int, std::shared_ptr<channel>> channels;
+    };
+
     void InitEventMode_(int trigMode);
-    void AddClient_(int fd, sockaddr_in addr);
-  
-    void DealListen_();
-    void DealWrite_(HttpConn* client);
-    void DealRead_(HttpConn* client);
+    void InitLoops_();
+    void ListenInLoop_(LoopContext* ctx);
+
+    void NewConnection_(int fd, const InetAddress& peerAddr);
+    LoopContext* NextLoop_();
 
+    void AddClient_(LoopContext* ctx, int fd, sockaddr_in addr);
     void SendError_(int fd, const char*info);
-    void ExtentTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
+    void CloseConn_(LoopContext* ctx, int fd, channel* ch, bool cancelTimer);
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
+    void OnRead_(LoopContext* ctx, int fd, channel* ch);
+    void OnWrite_(LoopContext* ctx, int fd, channel* ch);
+    void OnProcess_(LoopContext* ctx, int fd, channel* ch);
+    void UpdateEvents_(LoopContext* ctx, channel* ch, uint32_t events);
+    static bool IsActive_(const LoopContext* ctx, int fd, const channel* ch);
 
     static const int MAX_FD = 65536;
 
-    static int SetFdNonblock(int fd);
-
     int port_;
     bool openLinger_;
     int timeoutMS_;  /* 毫秒MS */
     bool isClose_;
-    int listenFd_;
+    int threadNum_;  /* sub reactor数量, 0时baseLoop兼做IO */
+    bool reusePort_;
     char* srcDir_;
-    
-    uint32_t listenEvent_;
+
     uint32_t connEvent_;
-   
-    std::unique_ptr<timer> timer_;
-    std::unique_ptr<ThreadPool> threadpool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
-};
\ No newline at end of file
+
+    std::unique_ptr<eventLoop> baseLoop_;
+    std::unique_ptr<Acceptor> acceptor_;            /* 主reactor的Acceptor */
+    std::unique_ptr<eventLoopThreadPool> loopPool_;
+    std::vector<std::unique_ptr<LoopContext>> loopCtxs_;
+    size_t nextLoop_;
+};
@@ -0,0 +1,21 @@
+#include "inetAddress.hpp"
+
+InetAddress::InetAddress(uint16_t port, bool loopbackOnly)
+{
+    memset(&addr_, 0, sizeof(addr_));
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    addr_.sin_port = htons(port);
+}
+
+std::string InetAddress::toIp() const
+{
+    char buf[INET_ADDRSTRLEN] = {0};
+    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
+    return buf;
+}
+
+uint16_t InetAddress::port() const
+{
+    return ntohs(addr_.sin_port);
+}
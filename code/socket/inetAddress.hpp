@@ -0,0 +1,32 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <cstring>
+#include <string>
+
+// 对sockaddr_in的封装，Acceptor/Socket使用它传递地址（只支持IPv4）
+class InetAddress
+{
+public:
+
+    // 监听地址，默认INADDR_ANY，loopbackOnly为true时只监听127.0.0.1
+    explicit InetAddress(uint16_t port = 0, bool loopbackOnly = false);
+
+    // accept得到的对端地址
+    explicit InetAddress(const struct sockaddr_in& addr) : addr_(addr) {}
+
+    const struct sockaddr_in& get_sockaddr_in() const { return addr_; }
+    void set_sockaddr_in(const struct sockaddr_in& addr) { addr_ = addr; }
+
+    // 点分十进制ip
+    std::string toIp() const;
+
+    // 主机字节序端口
+    uint16_t port() const;
+
+private:
+
+    struct sockaddr_in addr_;
+};
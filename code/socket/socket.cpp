@@ -0,0 +1,72 @@
+#include "socket.hpp"
+
+Socket::Socket() : fd_(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))
+{
+    if (fd_ < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "Failed to create socket");
+    }
+}
+
+Socket::~Socket()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void Socket::bindAddress(const struct sockaddr_in& addr)
+{
+    if (::bind(fd_, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "Failed to bind socket");
+    }
+}
+
+void Socket::listenFD()
+{
+    if (::listen(fd_, SOMAXCONN) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "Failed to listen socket");
+    }
+}
+
+int Socket::acceptFD(struct sockaddr_in* peeraddr)
+{
+    socklen_t len = sizeof(*peeraddr);
+    return ::accept4(fd_, reinterpret_cast<struct sockaddr*>(peeraddr), &len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+void Socket::setReuseAddr(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "Failed to set SO_REUSEADDR");
+    }
+}
+
+void Socket::setReusePort(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "Failed to set SO_REUSEPORT");
+    }
+}
+
+void Socket::setLinger(bool on)
+{
+    struct linger optLinger = {0, 0};
+    if (on)
+    {
+        optLinger.l_onoff = 1;
+        optLinger.l_linger = 1;
+    }
+    if (::setsockopt(fd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger)) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "Failed to set SO_LINGER");
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <system_error>
+
+// 对监听socket文件描述符的RAII封装，析构时关闭fd
+// 出错时和epoller一样抛出std::system_error
+class Socket
+{
+public:
+
+    // 创建非阻塞、close-on-exec的TCP socket
+    Socket();
+
+    // 接管一个已有的fd
+    explicit Socket(int fd) : fd_(fd) {}
+
+    ~Socket();
+
+    // 禁用拷贝和赋值
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    int fd() const { return fd_; }
+
+    void bindAddress(const struct sockaddr_in& addr);
+
+    void listenFD();
+
+    // 成功返回非阻塞的连接fd，失败返回-1（errno保留，EAGAIN表示已取完）
+    int acceptFD(struct sockaddr_in* peeraddr);
+
+    void setReuseAddr(bool on);
+
+    // 多个socket绑定同一端口，由内核在它们之间分发连接
+    void setReusePort(bool on);
+
+    // 优雅关闭: 直到所剩数据发送完毕或超时，accept出的连接会继承该选项
+    void setLinger(bool on);
+
+private:
+
+    int fd_;
+};
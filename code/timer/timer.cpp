@@ -1,154 +1,266 @@
 #include "timer.hpp"
 
-void timer::siftup_(size_t i)
+#include <algorithm>
+#include <cerrno>
+
+timer::timer()
+    : timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      armed_(false),
+      current_(nowTick_()),
+      size_(0),
+      expiring_(-1)
 {
-    assert(i < heap_.size());
-    
-    while (i > 0)
+    if (timer_fd_ < 0)
     {
-        size_t parent = (i - 1) / 2;
+        throw std::system_error(errno, std::system_category(), "Failed to create timerfd");
+    }
 
-        if (heap_[parent] < heap_[i])
-        {
-            break;
-        }
-        
-        swapNode_(i, parent);
-        i = parent;
+    for (int i = 0; i < TVR_SIZE; i++) tv1_[i] = -1;
+    for (int l = 0; l < LEVELS; l++)
+    {
+        for (int i = 0; i < TVN_SIZE; i++) tvn_[l][i] = -1;
     }
 }
 
-void timer::swapNode_(size_t i, size_t j)
+timer::~timer()
 {
-    assert(i < heap_.size() && j < heap_.size());
+    clear();
+    close(timer_fd_);
+}
 
-    std::swap(heap_[i], heap_[j]);
-    ref_[heap_[i].id] = i;
-    ref_[heap_[j].id] = j;
-} 
+uint64_t timer::nowTick_()
+{
+    auto now = std::chrono::duration_cast<ms>(steadyClock::now().time_since_epoch()).count();
+    return static_cast<uint64_t>(now) / TICK_MS;
+}
 
-bool timer::siftdown_(size_t index, size_t n)
+void timer::link_(int id, int* head)
 {
-    assert(index < heap_.size());
+    timerNode& node = nodes_[id];
+    node.head = head;
+    node.prev = -1;
+    node.next = *head;
+    if (*head >= 0) nodes_[*head].prev = id;
+    *head = id;
+}
 
-    size_t i = index;
-    size_t j = i * 2 + 1;
+void timer::unlink_(int id)
+{
+    timerNode& node = nodes_[id];
+    assert(node.head);
 
-    while(j < n)
+    if (node.prev >= 0) nodes_[node.prev].next = node.next;
+    else *node.head = node.next;
+    if (node.next >= 0) nodes_[node.next].prev = node.prev;
+
+    node.head = nullptr;
+    node.prev = node.next = -1;
+}
+
+void timer::place_(int id)
+{
+    timerNode& node = nodes_[id];
+    uint64_t expires = node.expires;
+    uint64_t idx = expires - current_;
+    int* head;
+
+    if (expires < current_)
+    {
+        // 已经到期（只会在cascade时出现），放到当前槽立即处理
+        head = &tv1_[current_ & (TVR_SIZE - 1)];
+    }
+    else if (idx < TVR_SIZE)
+    {
+        head = &tv1_[expires & (TVR_SIZE - 1)];
+    }
+    else
     {
-        if(j + 1 < n && heap_[j + 1] < heap_[j]) j++;
-        if(heap_[i] < heap_[j]) break;
-        swapNode_(i, j);
-        i = j;
-        j = i * 2 + 1;
+        // 超出最大范围的按最大范围处理
+        uint64_t maxIdx = (1ULL << (TVR_BITS + LEVELS * TVN_BITS)) - 1;
+        if (idx > maxIdx)
+        {
+            expires = current_ + maxIdx;
+            idx = maxIdx;
+        }
+
+        int level = 0;
+        while (idx >= (1ULL << (TVR_BITS + (level + 1) * TVN_BITS)))
+        {
+            level++;
+        }
+        int slot = (expires >> (TVR_BITS + level * TVN_BITS)) & (TVN_SIZE - 1);
+        head = &tvn_[level][slot];
     }
-    return i > index;
+    link_(id, head);
 }
 
 void timer::add(int id, int timeout, const timeoutCallback& cb)
 {
     assert(id >= 0);
-    std::lock_guard<std::mutex> lock(mutex_);
 
-    if(ref_.count(id) == 0)
+    if (static_cast<size_t>(id) >= nodes_.size())
+    {
+        nodes_.resize(id + 1);
+    }
+
+    // 空闲期间没有推进current_，先对齐到当前时间
+    if (size_ == 0)
+    {
+        current_ = std::max(current_, nowTick_());
+    }
+
+    timerNode& node = nodes_[id];
+    if (node.head)
     {
-        // 新节点：堆尾插入，调整堆
-        size_t i = heap_.size();
-        ref_[id] = i;
-        heap_.push_back({id, clock::now() + ms(timeout), cb});
-        siftup_(i);
-    } 
+        unlink_(id);
+    }
     else
     {
-        // 已有结点：调整堆
-        size_t i = ref_[id];
-        heap_[i].expires = clock::now() + ms(timeout);
-        heap_[i].cb = cb;
-        if (!siftdown_(i, heap_.size()))
-        {
-            siftup_(i);
-        }
+        size_++;
     }
+
+    // 至少在下一个tick触发，当前槽已经处理过了
+    uint64_t expires = nowTick_() + (timeout + TICK_MS - 1) / TICK_MS;
+    node.expires = std::max(expires, current_ + 1);
+    node.cb = cb;
+    place_(id);
+
+    if (!armed_) arm_(true);
 }
 
-void timer::doWork(int id)
+void timer::adjust(int id, int timeout)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    if (static_cast<size_t>(id) >= nodes_.size() || !nodes_[id].head) return;
 
-    // 删除指定id结点，并触发回调函数
-    if(heap_.empty() || ref_.count(id) == 0) return;
+    timerNode& node = nodes_[id];
+    uint64_t expires = std::max(nowTick_() + (timeout + TICK_MS - 1) / TICK_MS, current_ + 1);
+    if (expires >= node.expires)
+    {
+        // 只是延后，所在槽到期时再重新放置
+        node.expires = expires;
+    }
+    else
+    {
+        unlink_(id);
+        node.expires = expires;
+        place_(id);
+    }
+}
 
-    size_t i = ref_[id];
-    timerNode node = heap_[i];
-    node.cb();
-    del_(i);
+void timer::cancel(int id)
+{
+    if (static_cast<size_t>(id) >= nodes_.size() || !nodes_[id].head) return;
+
+    unlink_(id);
+    nodes_[id].cb = nullptr;
+    size_--;
 }
 
-void timer::del_(size_t index)
+void timer::doWork(int id)
 {
-    // 删除指定位置的结点
-    assert(!heap_.empty() && index < heap_.size());
+    // 删除指定id结点，并触发回调函数
+    if (static_cast<size_t>(id) >= nodes_.size() || !nodes_[id].head) return;
 
-    // 将要删除的结点换到队尾，然后调整堆
-    size_t i = index;
-    size_t n = heap_.size() - 1;
+    unlink_(id);
+    size_--;
+    timeoutCallback cb = std::move(nodes_[id].cb);
+    cb();
+}
 
-    if(i < n)
+void timer::clear()
+{
+    for (size_t id = 0; id < nodes_.size(); id++)
     {
-        swapNode_(i, n);
-        heap_.pop_back();
-        ref_.erase(heap_[i].id);
-
-        if (!siftdown_(i, heap_.size()))
-        {
-            siftup_(i);
-        }
+        if (nodes_[id].head) unlink_(id);
+        nodes_[id].cb = nullptr;
     }
-    else
+    size_ = 0;
+    if (armed_) arm_(false);
+}
+
+void timer::cascade_(int* head)
+{
+    while (*head >= 0)
     {
-        // 队尾元素删除
-        ref_.erase(heap_.back().id);
-        heap_.pop_back();
+        int id = *head;
+        unlink_(id);
+        place_(id);
     }
 }
 
-void timer::tick()
+void timer::runTick_()
 {
-    // 清除超时结点
-    if(heap_.empty()) return;
+    current_++;
 
-    while (!heap_.empty())
+    // 第0层转完一圈，逐层把上层的槽分配下来
+    int index = current_ & (TVR_SIZE - 1);
+    for (int level = 0; index == 0 && level < LEVELS; level++)
     {
-        timerNode node = heap_.front();
-        auto now = clock::now();
+        index = (current_ >> (TVR_BITS + level * TVN_BITS)) & (TVN_SIZE - 1);
+        cascade_(&tvn_[level][index]);
+    }
 
-        if(std::chrono::duration_cast<ms>(node.expires - now).count() > 0) break; 
+    // 把当前槽整体摘到expiring_上再逐个处理，回调里可以安全地add/cancel
+    int* slot = &tv1_[current_ & (TVR_SIZE - 1)];
+    while (*slot >= 0)
+    {
+        int id = *slot;
+        unlink_(id);
+        link_(id, &expiring_);
+    }
 
-        node.cb();
-        pop();
+    while (expiring_ >= 0)
+    {
+        int id = expiring_;
+        timerNode& node = nodes_[id];
+        unlink_(id);
+
+        if (node.expires > current_)
+        {
+            // adjust延后过，重新放置
+            place_(id);
+            continue;
+        }
+
+        size_--;
+        timeoutCallback cb = std::move(node.cb);
+        cb();
     }
 }
 
-void timer::pop()
+void timer::tick()
 {
-    del_(0);
-}
+    uint64_t now = nowTick_();
+    while (current_ < now)
+    {
+        if (size_ == 0)
+        {
+            // 没有定时器时直接跳到当前时间
+            current_ = now;
+            break;
+        }
+        runTick_();
+    }
 
-void timer::clear()
-{
-    std::lock_guard<std::mutex> lock(mutex_);
-    ref_.clear();
-    heap_.clear();
+    if (size_ == 0 && armed_) arm_(false);
 }
 
-int timer::getNextTick()
+void timer::handleRead()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t expirations = 0;
+    ssize_t n = read(timer_fd_, &expirations, sizeof(expirations));
+    (void)n;
     tick();
+}
 
-    if (!heap_.empty()) return -1;
-
-    auto now = clock::now();
-    auto diff = std::chrono::duration_cast<ms>(heap_.front().expires - now).count();
-    return diff > 0 ? static_cast<int>(diff) : 0;
-}
\ No newline at end of file
+void timer::arm_(bool on)
+{
+    struct itimerspec spec = {};
+    if (on)
+    {
+        spec.it_value.tv_nsec = TICK_MS * 1000 * 1000;
+        spec.it_interval.tv_nsec = TICK_MS * 1000 * 1000;
+    }
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+    armed_ = on;
+}
@@ -1,13 +1,14 @@
 #pragma once
 
-#include <queue>
-#include <unordered_map>
 #include <vector>
-#include <algorithm>
-#include <functional> 
+#include <functional>
 #include <cassert>
 #include <chrono>
-#include <mutex>
+#include <cstdint>
+#include <system_error>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include "../log/log.h"
 
@@ -15,83 +16,130 @@
 // 使用timerfd_create创建一个timerfd，注册到epoll中。
 // 当定时时间到达时，timerfd会产生可读事件，从而唤醒loop
 // loop在对应的handle函数中执行超时任务的回调函数。
-// Muduo的TimerQueue使用最小堆或有序容器存储定时器事件。
-// 在定时器超时后，通过timerfd通知EventLoop进行回调处理。
 // 超时关闭逻辑：
 // 可以在TcpConnection或类似连接管理处添加定时器
 // 当连接在一定时间内无数据读写，则关闭连接。添加定时器时关联fd与超时事件，到期删除连接。
-// 下面会在代码中演示TimerQueue和Timer类的修改：
-// 使用timerfd取代原先的纯软件定时轮询方式
-// 在eventLoop中与epoller集成，让定时事件像IO事件一样统一处理。
 
 // 清理长时间未活动的连接（超时处理），超时关闭空闲连接
 // 定期输出统计日志
 // 刷新缓存、重载配置
 
+// 实现：分层时间轮（与Linux内核的timer wheel相同的分层方式）
+// 第0层256个槽，每槽一个tick(TICK_MS)；第1~3层各64个槽，每层的一个槽等于下一层转一圈
+// 第0层转完一圈时，把上层对应槽里的定时器重新分配到下层（cascade）
+// 定时器以id（连接fd）为下标存放在平铺数组中，槽内用双向链表串起来：
+//   add/cancel是O(1)的链表操作
+//   adjust只把到期时间往后改（惰性刷新），到期槽被处理时发现还没到期再重新放入，也是O(1)
+// timer属于某一个eventLoop，只在loop线程中访问，不加锁
+// timerfd只在有定时器时以TICK_MS为周期触发，没有定时器时关闭
+
 // 定义超时回调函数类型
 using timeoutCallback = std::function<void()>;
-using clock = std::chrono::steady_clock;
+using steadyClock = std::chrono::steady_clock;
 using ms = std::chrono::milliseconds;
-using timeStamp = clock::time_point;
 
-// 定时器节点结构体
+// 定时器节点，以id为下标存放
 struct timerNode
 {
-    int id;
-    timeStamp expires;
+    uint64_t expires = 0;   // 到期的tick
     timeoutCallback cb;
-
-    bool operator<(const timerNode& t) const
-    {
-        // 优先级队列按小顶堆排序，所以这里反向比较
-        return expires > t.expires;
-    }
+    int prev = -1;          // 同一个槽内的前后节点id
+    int next = -1;
+    int* head = nullptr;    // 所在槽的链表头，nullptr表示未挂在轮上
 };
 
-// 定时器堆管理类
+// 时间轮定时器
 class timer
 {
 public:
 
-    timer() = default;
+    timer();
 
-    ~timer() { clear(); }
+    ~timer();
 
     // 禁用拷贝和赋值
     timer(const timer&) = delete;
     timer& operator=(const timer&) = delete;
 
-    // 添加或修改定时器
+    // 添加或修改定时器（已存在时替换回调和超时时间）
     void add(int id, int timeout, const timeoutCallback& cb);
 
+    // 调整定时器的超时时间（连接有新的读写事件时延长）
+    void adjust(int id, int timeout);
+
+    // 删除定时器但不执行回调
+    void cancel(int id);
+
     // 删除定时器并执行回调
     void doWork(int id);
 
     // 清除所有定时器
     void clear();
 
-    // 处理超时定时器
+    // 推进时间轮到当前时间，执行到期的回调
     void tick();
 
-    void pop();
+    // timerfd的读回调，由eventLoop注册到epoller
+    void handleRead();
 
-    // 获取下一个定时器的超时时间（毫秒）
-    int getNextTick();
+    // 注册到epoller的timerfd
+    int fd() const { return timer_fd_; }
+
+    // 定时器数量
+    size_t size() const { return size_; }
+
+    // 时间轮的精度（毫秒）
+    static const int TICK_MS = 10;
 
 private:
 
-    void del_(size_t i);
-    
-    void siftup_(size_t i);
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int LEVELS = 3;
+
+    // 当前时间对应的tick
+    static uint64_t nowTick_();
+
+    // 按到期时间把节点挂到对应层的槽里
+    void place_(int id);
+
+    void link_(int id, int* head);
 
-    bool siftdown_(size_t index, size_t n);
+    void unlink_(int id);
 
-    void swapNode_(size_t i, size_t j);
+    // 把上层某个槽的节点重新分配到下层
+    void cascade_(int* head);
+
+    // 处理一个tick
+    void runTick_();
+
+    // 有定时器时打开周期性的timerfd，没有时关闭
+    void arm_(bool on);
+
+    int timer_fd_;
+
+    bool armed_;
+
+    // 已处理到的tick
+    uint64_t current_;
+
+    size_t size_;
+
+    std::vector<timerNode> nodes_;
+
+    int tv1_[TVR_SIZE];
+    int tvn_[LEVELS][TVN_SIZE];
+
+    // 正在处理的到期链表，节点在回调里被cancel时也能正确摘除
+    int expiring_;
+};
 
-    std::vector<timerNode> heap_;
 
-    std::unordered_map<int, size_t> ref_;
 
-    // 保护heap_和ref_
-    std::mutex mutex_;
-};
\ No newline at end of file
+// 线程池（Thread Pool）：
+// 当请求大量涌入时，动态创建/销毁线程的开销很大（包含系统调用和调度开销）
+// 使用线程池可以在启动服务器时就创建固定数量的工作线程，将请求任务分配给这些线程执行
+// 而不是每次请求来临时创建线程。这样减少了创建线程的成本、上下文切换的频率，
+// 并提高服务器的并发处理效率。
@@ -13,6 +13,9 @@ namespace mylog{
         Buffer() : write_pos_(0), read_pos_(0) {
             buffer_.resize(g_conf_data->buffer_size);
         }
+        explicit Buffer(size_t size) : write_pos_(0), read_pos_(0) {
+            buffer_.resize(size);
+        }
 
         void Push(const char *data, size_t len)
         {
@@ -62,9 +65,10 @@ namespace mylog{
     protected:
         void ToBeEnough(size_t len)
         {
-            int buffersize = buffer_.size();
-            if (len >= WriteableSize())
+            // 一次扩容可能仍放不下超长的数据，扩到足够为止
+            while (len >= WriteableSize())
             {
+                size_t buffersize = buffer_.size();
                 if (buffer_.size() < g_conf_data->threshold)
                 {
                     buffer_.resize(2 * buffer_.size() + buffersize);
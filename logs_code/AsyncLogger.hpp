@@ -2,170 +2,275 @@
 #include <atomic>
 #include <cassert>
 #include <cstdarg>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include <memory>
 #include <mutex>
 
 #include "Level.hpp"
 #include "AsyncWorker.hpp"
 #include "Message.hpp"
+#include "Deferred.hpp"
 #include "LogFlush.hpp"
 #include "backlog/CliBackupLog.hpp"
-#include "ThreadPoll.hpp"
-
-extern ThreadPool *tp;
 
 namespace mylog
 {
+    // 日志器的一个落地方向，等级低于min_level的日志不会进入它的队列
+    struct Route
+    {
+        LogFlush::ptr flush;
+        LogLevel::value min_level = LogLevel::value::DEBUG;
+    };
+
     class AsyncLogger
     {
     public:
         using ptr = std::shared_ptr<AsyncLogger>;
         AsyncLogger(const std::string &logger_name, std::vector<LogFlush::ptr> &flushs, AsyncType type)
+            : AsyncLogger(logger_name, flushs, OverflowPolicy::FromType(type)) {}
+        AsyncLogger(const std::string &logger_name, std::vector<LogFlush::ptr> &flushs,
+                    const OverflowPolicy &policy)
+            : AsyncLogger(logger_name, ToRoutes(flushs), policy) {}
+        // 每个落地方向有自己的异步工作器(队列和线程)，慢的落地方向(如每批fsync的文件)
+        // 不会拖慢其他方向，溢出策略分别作用在每个方向的队列上；
+        // SPILL时一行日志无论有几个方向写不下，都只在溢出文件中写一次
+        AsyncLogger(const std::string &logger_name, const std::vector<Route> &routes,
+                    const OverflowPolicy &policy)
             : logger_name_(logger_name),//初始化日志器的名字
-              flushs_(flushs.begin(), flushs.end()),//添加实例化方式给日志器，如日志输出到文件还是标准输出，可能有多种
-              asyncworker(std::make_shared<AsyncWorker>(//启动异步工作器
-                  std::bind(&AsyncLogger::RealFlush, this, std::placeholders::_1),
-                  type)) {}
-        virtual ~AsyncLogger() {};
+              spill_fd_(OpenSpill(policy))
+        {
+            for (const Route &route : routes)
+            {
+                sinks_.emplace_back(new Sink{route.flush, route.min_level});
+                Sink *sink = sinks_.back().get();
+                sink->worker = std::make_shared<AsyncWorker>(//启动异步工作器
+                    std::bind(&AsyncLogger::RealFlush, this, sink, std::placeholders::_1),
+                    policy,
+                    [](const char *, size_t) { spill_pending_ = true; });
+            }
+        }
+        virtual ~AsyncLogger()
+        {
+            for (auto &sink : sinks_)
+                sink->worker->Stop();
+            if (spill_fd_ >= 0)
+                close(spill_fd_);
+        };
         std::string Name() { return logger_name_; }
+        // 缓冲区写满时丢弃、阻塞的统计是各落地方向的计数之和，溢出按行计数
+        OverflowStats Stats() const
+        {
+            OverflowStats total;
+            for (auto &sink : sinks_)
+            {
+                OverflowStats s = sink->worker->Stats();
+                total.dropped_lines += s.dropped_lines;
+                total.dropped_bytes += s.dropped_bytes;
+                total.blocked_lines += s.blocked_lines;
+                total.blocked_bytes += s.blocked_bytes;
+            }
+            total.spilled_lines = spilled_lines_.load(std::memory_order_relaxed);
+            total.spilled_bytes = spilled_bytes_.load(std::memory_order_relaxed);
+            return total;
+        }
         //该函数则是特定日志级别的日志信息的格式化，当外部调用该日志器时，使用debug模式的日志就会进来
         //在serialize时把日志信息中的日志级别定义为DEBUG。
-        void Debug(const std::string &file, size_t line, const std::string format,
-                   ...)
+        void Debug(const char *file, size_t line, const char *format, ...)
+            __attribute__((format(printf, 4, 5)))
         {
             // 获取可变参数列表中的格式
             va_list va;
             va_start(va, format);
-            char *ret;
-            int r = vasprintf(&ret, format.c_str(), va);
-            if (r == -1)
-                perror("vasprintf failed!!!: ");
+            serialize(LogLevel::value::DEBUG, file, line, format, va); // 生成格式化日志信息并写文件
             va_end(va); // 将va指针置空
-
-            serialize(LogLevel::value::DEBUG, file, line,
-                      ret); // 生成格式化日志信息并写文件
-
-            free(ret);
-            ret = nullptr;
         };
-        void Info(const std::string &file, size_t line, const std::string format,
-                  ...)
+        void Info(const char *file, size_t line, const char *format, ...)
+            __attribute__((format(printf, 4, 5)))
         {
             va_list va;
             va_start(va, format);
-            char *ret;
-            int r = vasprintf(&ret, format.c_str(), va);
-            if (r == -1)
-                perror("vasprintf failed!!!: ");
+            serialize(LogLevel::value::INFO, file, line, format, va);
             va_end(va);
-
-            serialize(LogLevel::value::INFO, file, line,
-                      ret);
-
-            free(ret);
-            ret = nullptr;
         };
 
-        void Warn(const std::string &file, size_t line, const std::string format,
-                  ...)
+        void Warn(const char *file, size_t line, const char *format, ...)
+            __attribute__((format(printf, 4, 5)))
         {
             va_list va;
             va_start(va, format);
-            char *ret;
-            int r = vasprintf(&ret, format.c_str(), va);
-            if (r == -1)
-                perror("vasprintf failed!!!: ");
+            serialize(LogLevel::value::WARN, file, line, format, va);
             va_end(va);
-
-            serialize(LogLevel::value::WARN, file, line,
-                      ret);
-            free(ret);
-            ret = nullptr;
         };
-        void Error(const std::string &file, size_t line, const std::string format,
-                   ...)
+        void Error(const char *file, size_t line, const char *format, ...)
+            __attribute__((format(printf, 4, 5)))
         {
             va_list va;
             va_start(va, format);
-            char *ret;
-            int r = vasprintf(&ret, format.c_str(), va);
-            if (r == -1)
-                perror("vasprintf failed!!!: ");
+            serialize(LogLevel::value::ERROR, file, line, format, va);
             va_end(va);
-
-            serialize(LogLevel::value::ERROR, file, line,
-                      ret);
-
-            free(ret);
-            ret = nullptr;
         };
-        void Fatal(const std::string &file, size_t line, const std::string format,
-                   ...)
+        void Fatal(const char *file, size_t line, const char *format, ...)
+            __attribute__((format(printf, 4, 5)))
         {
             va_list va;
             va_start(va, format);
-            char *ret;
-            int r = vasprintf(&ret, format.c_str(), va);
-            if (r == -1)
-                perror("vasprintf failed!!!: ");
+            serialize(LogLevel::value::FATAL, file, line, format, va);
             va_end(va);
-
-            serialize(LogLevel::value::FATAL, file, line,
-                      ret);
-
-            free(ret);
-            ret = nullptr;
         };
 
+        // 延迟格式化：调用线程只把参数编码进异步缓冲区，由后台线程生成文本。
+        // format必须是字符串字面量，一般通过MyLog.hpp中的MYLOG_*宏调用，宏会在编译期检查格式串
+        template <typename... Args>
+        void Log(LogLevel::value level, const char *file, size_t line,
+                 const char *format, const Args &...args)
+        {
+            std::string_view record = Deferred::Encode(level, file, line, format, args...);
+            if (level == LogLevel::value::FATAL ||
+                level == LogLevel::value::ERROR)
+            { // 远程备份需要文本，只有这两个等级在调用线程上渲染
+                thread_local std::string data;
+                data.clear();
+                Deferred::Renderer().Render(record.data(), record.size(), logger_name_, data);
+                Backup(data.data(), data.size());
+            }
+            Flush(record.data(), record.size(), level);
+        }
+
     protected:
         //在这里将日志消息组织起来，并写入文件
-        void serialize(LogLevel::value level, const std::string &file, size_t line,
-                       char *ret)
+        //整行日志在本线程的缓冲区里格式化，只有写入异步缓冲区时拷贝一次
+        void serialize(LogLevel::value level, const char *file, size_t line,
+                       const char *format, va_list va)
         {
-            // std::cout << "Debug:serialize begin\n";
-            LogMessage msg(level, file, line, logger_name_, ret);
-            std::string data = msg.format();
+            LogMessage msg(level, file, line, logger_name_);
+            std::string_view data = msg.Format(format, va);
             if (level == LogLevel::value::FATAL ||
                 level == LogLevel::value::ERROR)
-            {
-                try
-                {
-                    auto ret = tp->enqueue(start_backup, data);
-                    ret.get();
-                }
-                catch (const std::runtime_error &e)
-                {
-                    // 该线程池没有把stop设置为true的逻辑，所以不做处理
-                    std::cout << __FILE__ << __LINE__ << "thread pool closed" << std::endl;
-                }
+                Backup(data.data(), data.size());
+             //获取到日志信息后就可以输出到异步缓冲区了，异步工作器后续会对其进行刷盘
+            Flush(data.data(), data.size(), level);
+        }
+
+        // 交给后台发送线程，不等待网络
+        void Backup(const char *data, size_t len)
+        {
+            LogShipper::GetInstance().Ship(data, len);
+        }
+
+        void Flush(const char *data, size_t len, LogLevel::value level)
+        {
+            spill_pending_ = false;
+            for (auto &sink : sinks_)
+            { // Push函数本身是线程安全的，这里不加锁
+                if (level >= sink->min_level)
+                    sink->worker->Push(data, len, level);
             }
-             //获取到string类型的日志信息后就可以输出到异步缓冲区了，异步工作器后续会对其进行刷盘
-            Flush(data.c_str(), data.size());
+            if (spill_pending_) // 有落地方向写不下，工作器在本线程上标记过
+                Spill(data, len);
+        }
 
-            // std::cout << "Debug:serialize Flush\n";
+        static std::vector<Route> ToRoutes(const std::vector<LogFlush::ptr> &flushs)
+        {
+            std::vector<Route> routes;
+            for (auto &flush : flushs)
+                routes.push_back(Route{flush});
+            return routes;
         }
 
-        void Flush(const char *data, size_t len)
+        static int OpenSpill(const OverflowPolicy &policy)
         {
-            asyncworker->Push(data, len); // Push函数本身是线程安全的，这里不加锁
+            if (policy.action != OverflowPolicy::Action::SPILL || policy.spill_path.empty())
+                return -1;
+            Util::File::CreateDirectory(Util::File::Path(policy.spill_path));
+            int fd = open(policy.spill_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "open spill file failed" << std::endl;
+                perror(NULL);
+            }
+            return fd;
         }
 
-        void RealFlush(Buffer &buffer)
-        { // 由异步线程进行实际写文件
-            if (flushs_.empty())
+        // 溢出文件只保存文本，延迟格式化的记录在这里渲染
+        void Spill(const char *data, size_t len)
+        {
+            spilled_lines_.fetch_add(1, std::memory_order_relaxed);
+            spilled_bytes_.fetch_add(len, std::memory_order_relaxed);
+            if (spill_fd_ < 0)
                 return;
-            for (auto &e : flushs_)
-            {  //e是Flush这个类，即控制把日志输出到哪的类。
-                e->Flush(buffer.Begin(), buffer.ReadableSize());
+            thread_local std::string text;
+            if (len > 0 && *data == Deferred::record_tag)
+            {
+                text.clear();
+                Deferred::Renderer().Render(data, len, logger_name_, text);
+                data = text.data();
+                len = text.size();
+            }
+            // O_APPEND保证多个线程的写入不会交错
+            if (write(spill_fd_, data, len) < 0)
+                perror("write spill file failed: ");
+        }
+
+    protected:
+        // 一个落地方向和它的队列，renderer和rendered只由该方向的异步线程使用
+        struct Sink
+        {
+            LogFlush::ptr flush;
+            LogLevel::value min_level;
+            Deferred::Renderer renderer;
+            std::string rendered;
+            mylog::AsyncWorker::ptr worker;
+        };
+
+        void RealFlush(Sink *sink, Buffer &buffer)
+        { // 由该落地方向的异步线程进行实际写文件
+            const char *raw = buffer.Begin();
+            size_t raw_len = buffer.ReadableSize();
+            if (sink->flush->Binary())
+            { // 二进制格式直接编码原始数据
+                sink->flush->FlushBinary(logger_name_, raw, raw_len);
+                return;
+            }
+            if (memchr(raw, Deferred::record_tag, raw_len) != nullptr)
+            { // 缓冲区里有延迟格式化的记录，按原顺序和文本日志一起渲染
+                Render(*sink, raw, raw_len);
+                sink->flush->Flush(sink->rendered.data(), sink->rendered.size());
+                return;
+            }
+            sink->flush->Flush(raw, raw_len);
+        }
+
+        void Render(Sink &sink, const char *data, size_t len)
+        {
+            sink.rendered.clear();
+            const char *end = data + len;
+            while (data < end)
+            {
+                if (*data == Deferred::record_tag)
+                {
+                    data += sink.renderer.Render(data, end - data, logger_name_, sink.rendered);
+                    continue;
+                }
+                const char *next = static_cast<const char *>(
+                    memchr(data, Deferred::record_tag, end - data));
+                if (next == nullptr)
+                    next = end;
+                sink.rendered.append(data, next - data);
+                data = next;
             }
         }
 
     protected:
         std::mutex mtx_;
         std::string logger_name_;
-        std::vector<LogFlush::ptr> flushs_; // 输出到指定方向\
-    std::vector<LogFlush> flush_;不能使用logflush作为元素类型，logflush是纯虚类，不能实例化
-        mylog::AsyncWorker::ptr asyncworker;
+        int spill_fd_; // OverflowPolicy为SPILL时的溢出文件
+        std::atomic<uint64_t> spilled_lines_{0};
+        std::atomic<uint64_t> spilled_bytes_{0};
+        // 工作器的溢出回调在调用Push的线程上执行，只记下当前这行需要溢出
+        inline static thread_local bool spill_pending_ = false;
+        std::vector<std::unique_ptr<Sink>> sinks_; // 输出到指定方向
     };
 
     // 日志器建造
@@ -175,26 +280,72 @@ namespace mylog
         using ptr = std::shared_ptr<LoggerBuilder>;
         void BuildLoggerName(const std::string &name) { logger_name_ = name; }
         void BuildLopperType(AsyncType type) { async_type_ = type; }
+        // 指定后代替BuildLopperType决定缓冲区写满时的行为
+        void BuildOverflowPolicy(const OverflowPolicy &policy)
+        {
+            policy_ = policy;
+            has_policy_ = true;
+        }
         template <typename FlushType, typename... Args>
         void BuildLoggerFlush(Args &&...args)
         {
-            flushs_.emplace_back(
-                LogFlushFactory::CreateLog<FlushType>(std::forward<Args>(args)...));
+            routes_.push_back(Route{
+                LogFlushFactory::CreateLog<FlushType>(std::forward<Args>(args)...)});
+        }
+        // 只接收min_level及以上等级日志的落地方向
+        template <typename FlushType, typename... Args>
+        void BuildLevelFlush(LogLevel::value min_level, Args &&...args)
+        {
+            routes_.push_back(Route{
+                LogFlushFactory::CreateLog<FlushType>(std::forward<Args>(args)...), min_level});
         }
         AsyncLogger::ptr Build()
         {
             assert(logger_name_.empty() == false);// 必须有日志器名称
-            
+
+            // 配置文件中给这个日志器配置的落地方向追加在代码指定的之后
+            BuildConfigFlush();
             // 如果写日志方式没有指定，那么采用默认的标准输出
-            if (flushs_.empty())
-                flushs_.emplace_back(std::make_shared<StdoutFlush>());
+            if (routes_.empty())
+                routes_.push_back(Route{std::make_shared<StdoutFlush>()});
             return std::make_shared<AsyncLogger>(
-                logger_name_, flushs_, async_type_);
+                logger_name_, routes_,
+                has_policy_ ? policy_ : OverflowPolicy::FromType(async_type_));
+        }
+
+    protected:
+        void BuildConfigFlush()
+        {
+            for (const Util::SinkConf &conf : g_conf_data->sinks)
+            {
+                if (conf.logger != logger_name_ && conf.logger != "*")
+                    continue;
+                Route route;
+                if (!LogLevel::FromString(conf.min_level, route.min_level))
+                    std::cout << __FILE__ << __LINE__ << "unknown level in config: " << conf.min_level << std::endl;
+                LogFormat format = conf.format == "binary" ? LogFormat::BINARY : LogFormat::TEXT;
+                if (conf.type == "stdout")
+                    route.flush = std::make_shared<StdoutFlush>();
+                else if (conf.type == "file")
+                    route.flush = std::make_shared<FileFlush>(conf.path, format);
+                else if (conf.type == "roll")
+                    route.flush = std::make_shared<RollFileFlush>(conf.path, conf.max_size, format);
+                else if (conf.type == "async_roll")
+                    route.flush = std::make_shared<AsyncRollFileFlush>(conf.path, conf.max_size, format);
+                else
+                {
+                    std::cout << __FILE__ << __LINE__ << "unknown sink type in config: " << conf.type << std::endl;
+                    continue;
+                }
+                routes_.push_back(route);
+            }
         }
 
     protected:
         std::string logger_name_ = "async_logger"; // 日志器名称
-        std::vector<mylog::LogFlush::ptr> flushs_; // 写日志方式
+        std::vector<Route> routes_; // 写日志方式及各自的等级过滤
         AsyncType async_type_ = AsyncType::ASYNC_SAFE;//用于控制缓冲区是否增长
+        OverflowPolicy policy_;
+        bool has_policy_ = false;
     };
 } // namespace mylog
\ No newline at end of file
@@ -1,72 +1,256 @@
 #pragma once
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include "AsyncBuffer.hpp"
+#include "Level.hpp"
 
 namespace mylog {
 enum class AsyncType { ASYNC_SAFE, ASYNC_UNSAFE };
 using functor = std::function<void(Buffer&)>;
+using spill_functor = std::function<void(const char*, size_t)>;
+
+// 分片缓冲区写满时的处理方式。ASYNC_SAFE对应BLOCK，ASYNC_UNSAFE对应GROW
+struct OverflowPolicy {
+    enum class Action {
+        BLOCK,             // 阻塞生产者直到消费者取走数据
+        GROW,              // 缓冲区扩容，不丢数据也不阻塞
+        DROP_NEWEST,       // 丢弃当前这条日志
+        DROP_BELOW_LEVEL,  // 低于min_level的丢弃，其余阻塞
+        SAMPLE,            // 缓冲区过半后每sample_rate条保留一条，满时丢弃
+        SPILL              // 交给溢出回调写到磁盘上的溢出文件
+    };
+    Action action = Action::BLOCK;
+    LogLevel::value min_level = LogLevel::value::WARN;
+    size_t sample_rate = 10;
+    std::string spill_path;  // SPILL使用的文件，由日志器打开
+
+    static OverflowPolicy FromType(AsyncType type) {
+        OverflowPolicy policy;
+        policy.action = type == AsyncType::ASYNC_SAFE ? Action::BLOCK : Action::GROW;
+        return policy;
+    }
+};
+
+// 溢出统计，各计数单调递增
+struct OverflowStats {
+    uint64_t dropped_lines = 0;
+    uint64_t dropped_bytes = 0;
+    uint64_t blocked_lines = 0;  // 因缓冲区满而阻塞过的日志
+    uint64_t blocked_bytes = 0;
+    uint64_t spilled_lines = 0;
+    uint64_t spilled_bytes = 0;
+};
+
+// 生产者按线程分散到若干个分片(shard)上写入，每个分片有自己的锁和两块缓冲区，
+// 线程固定落在同一个分片，锁基本不会被争用，也不会为每一行日志唤醒消费者。
+// 消费者按时间间隔或某个分片积累到一定字节数时被唤醒，把所有分片的数据
+// 收集到一块缓冲区后一次交给回调落地。同一线程的日志保持顺序，不同线程之间
+// 只在一个批次内按分片排列。
 class AsyncWorker {
    public:
     using ptr = std::shared_ptr<AsyncWorker>;
+    static constexpr size_t max_shards = 8;
+    static constexpr size_t flush_bytes = 64 * 1024;  // 单个分片积累到该大小就唤醒消费者
+    static constexpr int flush_interval_ms = 50;      // 没有达到阈值时的最长落地间隔
+
     AsyncWorker(const functor& cb, AsyncType async_type = AsyncType::ASYNC_SAFE)
-        : async_type_(async_type),
-          callback_(cb),
+        : AsyncWorker(cb, OverflowPolicy::FromType(async_type)) {}
+    AsyncWorker(const functor& cb, const OverflowPolicy& policy,
+                const spill_functor& spill = spill_functor())
+        : policy_(policy),
+          spill_(spill),
           stop_(false),
-          thread_(std::thread(&AsyncWorker::ThreadEntry, this)) {}
+          ready_(false),
+          waiting_(false),
+          callback_(cb) {
+        if (policy_.sample_rate == 0) policy_.sample_rate = 1;
+        size_t n = std::thread::hardware_concurrency();
+        n = std::max<size_t>(1, std::min(n, max_shards));
+        // 总容量仍以配置的buffer_size为准，平均分给各个分片
+        size_t shard_size = std::max(g_conf_data->buffer_size / n, flush_bytes * 2);
+        for (size_t i = 0; i < n; ++i)
+            shards_.emplace_back(new Shard(shard_size));
+        thread_ = std::thread(&AsyncWorker::ThreadEntry, this);
+    }
     ~AsyncWorker() { Stop(); }
-    void Push(const char* data, size_t len) {
-        // 如果生产者队列不足以写下len长度数据，并且缓冲区是固定大小，那么阻塞
-        std::unique_lock<std::mutex> lock(mtx_);
-        if (AsyncType::ASYNC_SAFE == async_type_)
-            cond_productor_.wait(lock, [&]() {
-                return len <= buffer_productor_.WriteableSize();
-            });
-        buffer_productor_.Push(data, len);
-        cond_consumer_.notify_one();
+    void Push(const char* data, size_t len,
+              LogLevel::value level = LogLevel::value::INFO) {
+        Shard& shard = *shards_[ShardIndex() % shards_.size()];
+        size_t readable;
+        {
+            std::unique_lock<std::mutex> lock(shard.mtx);
+            Buffer& buf = shard.productor;
+            if (policy_.action == OverflowPolicy::Action::SAMPLE &&
+                buf.ReadableSize() >= shard.capacity / 2 &&
+                shard.sampled++ % policy_.sample_rate != 0) {
+                lock.unlock();
+                Drop(len);
+                return;
+            }
+            // 与Buffer::ToBeEnough的扩容条件一致；分片为空时仍写不下的超长日志直接写入，由缓冲区扩容
+            if (policy_.action != OverflowPolicy::Action::GROW &&
+                len >= buf.WriteableSize() && !buf.IsEmpty()) {
+                if (!Overflow(shard, lock, data, len, level)) return;
+            }
+            buf.Push(data, len);
+            readable = buf.ReadableSize();
+        }
+        // 快路径上只有一次无竞争的加锁，不发生系统调用
+        if (readable >= flush_bytes && !ready_.load(std::memory_order_relaxed))
+            Wakeup();
+    }
+    // 当前的溢出统计
+    OverflowStats Stats() const {
+        OverflowStats s;
+        s.dropped_lines = dropped_lines_.load(std::memory_order_relaxed);
+        s.dropped_bytes = dropped_bytes_.load(std::memory_order_relaxed);
+        s.blocked_lines = blocked_lines_.load(std::memory_order_relaxed);
+        s.blocked_bytes = blocked_bytes_.load(std::memory_order_relaxed);
+        s.spilled_lines = spilled_lines_.load(std::memory_order_relaxed);
+        s.spilled_bytes = spilled_bytes_.load(std::memory_order_relaxed);
+        return s;
     }
     void Stop() {
-        stop_ = true;
-        cond_consumer_.notify_all();  // 所有线程把缓冲区内数据处理完就结束了
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(wait_mtx_);
+            stop_ = true;
+        }
+        cond_consumer_.notify_all();  // 消费者把所有分片的数据处理完就结束了
         thread_.join();
     }
 
    private:
+    struct alignas(64) Shard {
+        explicit Shard(size_t size)
+            : capacity(size), productor(size), consumer(size) {}
+        std::mutex mtx;
+        std::condition_variable cond;  // BLOCK策略下生产者等待空间
+        size_t capacity;
+        size_t sampled = 0;  // SAMPLE策略的计数
+        mylog::Buffer productor;
+        mylog::Buffer consumer;  // 只由消费者线程访问
+    };
+
+    // 持有分片锁时调用，分片写不下len字节。返回true表示已有空间可以写入，
+    // false表示这条日志已被丢弃或溢出，返回时锁已释放
+    bool Overflow(Shard& shard, std::unique_lock<std::mutex>& lock,
+                  const char* data, size_t len, LogLevel::value level) {
+        using Action = OverflowPolicy::Action;
+        Wakeup();
+        bool block = policy_.action == Action::BLOCK ||
+                     (policy_.action == Action::DROP_BELOW_LEVEL &&
+                      level >= policy_.min_level);
+        if (block) {
+            blocked_lines_.fetch_add(1, std::memory_order_relaxed);
+            blocked_bytes_.fetch_add(len, std::memory_order_relaxed);
+            shard.cond.wait(lock, [&]() {
+                return len < shard.productor.WriteableSize() ||
+                       shard.productor.IsEmpty();
+            });
+            return true;
+        }
+        lock.unlock();
+        if (policy_.action == Action::SPILL && spill_) {
+            spill_(data, len);
+            spilled_lines_.fetch_add(1, std::memory_order_relaxed);
+            spilled_bytes_.fetch_add(len, std::memory_order_relaxed);
+            return false;
+        }
+        Drop(len);
+        return false;
+    }
+
+    void Drop(size_t len) {
+        dropped_lines_.fetch_add(1, std::memory_order_relaxed);
+        dropped_bytes_.fetch_add(len, std::memory_order_relaxed);
+    }
+
+    // 线程第一次写日志时轮流分配编号，线程数不超过分片数时互不共享分片
+    static size_t ShardIndex() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    void Wakeup() {
+        ready_.store(true);
+        // 与消费者设置waiting_后再检查ready_配对，二者至少有一方能看到对方
+        if (waiting_.load()) {
+            std::lock_guard<std::mutex> lock(wait_mtx_);
+            cond_consumer_.notify_one();
+        }
+    }
+
+    // 交换每个非空分片的缓冲区，锁内只做O(1)的交换，拷贝在锁外进行
+    void Collect() {
+        for (auto& s : shards_) {
+            Shard& shard = *s;
+            {
+                std::lock_guard<std::mutex> lock(shard.mtx);
+                if (shard.productor.IsEmpty()) continue;
+                shard.productor.Swap(shard.consumer);
+            }
+            // 固定容量的缓冲区才需要唤醒
+            if (policy_.action == OverflowPolicy::Action::BLOCK ||
+                policy_.action == OverflowPolicy::Action::DROP_BELOW_LEVEL)
+                shard.cond.notify_all();
+            buffer_consumer_.Push(shard.consumer.Begin(), shard.consumer.ReadableSize());
+            shard.consumer.Reset();
+        }
+    }
+
     void ThreadEntry() {
         while (1) {
-            {  // 缓冲区交换完就解锁，让productor继续写入数据
-                std::unique_lock<std::mutex> lock(mtx_);
-                if (buffer_productor_.IsEmpty() &&
-                    stop_)  // 有数据则交换，无数据就阻塞
-                    cond_consumer_.wait(lock, [&]() {
-                        return stop_ || !buffer_productor_.IsEmpty();
-                    });
-                buffer_productor_.Swap(buffer_consumer_);
-                // 固定容量的缓冲区才需要唤醒
-                if (async_type_ == AsyncType::ASYNC_SAFE)
-                    cond_productor_.notify_one();
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(wait_mtx_);
+                if (!stop_ && !ready_.load()) {
+                    waiting_.store(true);
+                    cond_consumer_.wait_for(
+                        lock, std::chrono::milliseconds(flush_interval_ms),
+                        [&]() { return stop_ || ready_.load(); });
+                    waiting_.store(false);
+                }
+                ready_.store(false);
+                stop = stop_;  // 在收集之前读取，保证退出前最后一轮会取走剩余数据
+            }
+            Collect();
+            if (!buffer_consumer_.IsEmpty()) {
+                callback_(buffer_consumer_);  // 调用回调函数对缓冲区中数据进行处理
+                buffer_consumer_.Reset();
             }
-            callback_(buffer_consumer_);  // 调用回调函数对缓冲区中数据进行处理
-            buffer_consumer_.Reset();
-            if (stop_ && buffer_productor_.IsEmpty()) return;
+            if (stop) return;
         }
     }
 
    private:
-    AsyncType async_type_;
-    std::atomic<bool> stop_;  // 用于控制异步工作器的启动
-    std::mutex mtx_;
-    mylog::Buffer buffer_productor_;
-    mylog::Buffer buffer_consumer_;
-    std::condition_variable cond_productor_;
+    OverflowPolicy policy_;
+    spill_functor spill_;
+    std::atomic<uint64_t> dropped_lines_{0};
+    std::atomic<uint64_t> dropped_bytes_{0};
+    std::atomic<uint64_t> blocked_lines_{0};
+    std::atomic<uint64_t> blocked_bytes_{0};
+    std::atomic<uint64_t> spilled_lines_{0};
+    std::atomic<uint64_t> spilled_bytes_{0};
+    bool stop_;                  // 由wait_mtx_保护
+    std::atomic<bool> ready_;    // 有分片达到阈值或生产者在等待空间
+    std::atomic<bool> waiting_;  // 消费者正在休眠
+    std::mutex wait_mtx_;
     std::condition_variable cond_consumer_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    mylog::Buffer buffer_consumer_;  // 一个批次的汇总，一次交给回调
     std::thread thread_;
 
     functor callback_;  // 回调函数，用来告知工作器如何落地
 };
-}  // namespace mylog
\ No newline at end of file
+}  // namespace mylog
@@ -0,0 +1,328 @@
+/*二进制日志格式：格式串、文件名等字符串只写一次，之后用编号引用，参数用varint编码*/
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Deferred.hpp"
+
+namespace mylog
+{
+    enum class LogFormat { TEXT, BINARY };
+
+    // 文件由若干条目组成，每个条目以一个类型字节开头:
+    //   MAGIC   "MYLOGB1\n"，清空编号表，每次打开或滚动文件时写入
+    //   STRING  varint编号 varint长度 字节   定义一个字符串编号
+    //   RECORD  等级(1字节) 时间差(zigzag varint，秒) 日志器/文件/行号/线程id/格式串编号
+    //           参数个数 参数...，参数为类型字节加数据: 整数用varint，浮点8字节，
+    //           字符串varint长度加字节
+    //   TEXT    varint长度 字节   调用线程上已格式化好的文本日志
+    namespace Binary
+    {
+        constexpr char magic[8] = {'M', 'Y', 'L', 'O', 'G', 'B', '1', '\n'};
+        enum Entry : uint8_t
+        {
+            ENTRY_STRING = 1,
+            ENTRY_RECORD = 2,
+            ENTRY_TEXT = 3,
+            ENTRY_MAGIC = 'M'
+        };
+
+        inline void PutVarint(std::string &out, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back(static_cast<char>(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back(static_cast<char>(v));
+        }
+
+        inline bool GetVarint(const char *&p, const char *end, uint64_t &v)
+        {
+            v = 0;
+            for (int shift = 0; p < end && shift < 64; shift += 7)
+            {
+                uint8_t b = static_cast<uint8_t>(*p++);
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return true;
+            }
+            return false;
+        }
+
+        inline uint64_t ZigZag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+        inline int64_t UnZigZag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+        // 由落地方式持有，编号表只对当前文件有效，换文件时调用Reset
+        class Encoder
+        {
+        public:
+            void Reset()
+            {
+                pointers_.clear();
+                strings_.clear();
+                next_id_ = 0;
+                last_time_ = 0;
+                started_ = false;
+            }
+
+            // 把异步缓冲区中的原始数据(文本日志和延迟格式化记录)编码后追加到out
+            void Encode(const std::string &logger, const char *data, size_t len, std::string &out)
+            {
+                if (!started_)
+                {
+                    out.append(magic, sizeof(magic));
+                    started_ = true;
+                }
+                const char *end = data + len;
+                while (data < end)
+                {
+                    if (*data != Deferred::record_tag)
+                    {
+                        const char *next = static_cast<const char *>(
+                            memchr(data, Deferred::record_tag, end - data));
+                        if (next == nullptr)
+                            next = end;
+                        out.push_back(static_cast<char>(ENTRY_TEXT));
+                        PutVarint(out, next - data);
+                        out.append(data, next - data);
+                        data = next;
+                        continue;
+                    }
+                    Deferred::RecordView r;
+                    if (!Deferred::Parse(data, end - data, r))
+                        break; // 记录不完整，丢弃剩余数据
+                    EncodeRecord(logger, r, out);
+                    data = r.end;
+                }
+            }
+
+        private:
+            void EncodeRecord(const std::string &logger, const Deferred::RecordView &r, std::string &out)
+            {
+                const Deferred::RecordHeader &h = r.header;
+                // 先确定编号，新字符串的定义要写在引用它的记录之前
+                uint32_t logger_id = InternContent(logger, out);
+                uint32_t file_id = InternPointer(h.file, out);
+                uint32_t tid_id = InternContent(r.tid, out);
+                uint32_t format_id = InternPointer(h.format, out);
+
+                out.push_back(static_cast<char>(ENTRY_RECORD));
+                out.push_back(static_cast<char>(h.level));
+                PutVarint(out, ZigZag(static_cast<int64_t>(h.ctime) - last_time_));
+                last_time_ = h.ctime;
+                PutVarint(out, logger_id);
+                PutVarint(out, file_id);
+                PutVarint(out, h.line);
+                PutVarint(out, tid_id);
+                PutVarint(out, format_id);
+                PutVarint(out, h.argc);
+
+                const char *p = r.args;
+                for (int i = 0; i < h.argc && p < r.end; ++i)
+                {
+                    auto c = static_cast<Deferred::Category>(*p++);
+                    out.push_back(static_cast<char>(c));
+                    if (c == Deferred::Category::STRING)
+                    {
+                        uint32_t n;
+                        memcpy(&n, p, sizeof(n));
+                        p += sizeof(n);
+                        PutVarint(out, n);
+                        out.append(p, n);
+                        p += n;
+                        continue;
+                    }
+                    uint64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    if (c == Deferred::Category::FLOAT)
+                        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+                    else if (c == Deferred::Category::INT)
+                        PutVarint(out, ZigZag(static_cast<int64_t>(v)));
+                    else
+                        PutVarint(out, v);
+                }
+            }
+
+            // 格式串和文件名是字符串字面量，按地址查找
+            uint32_t InternPointer(const char *s, std::string &out)
+            {
+                auto it = pointers_.find(s);
+                if (it != pointers_.end())
+                    return it->second;
+                uint32_t id = Define(s, out);
+                pointers_.emplace(s, id);
+                return id;
+            }
+
+            // 日志器名和线程id按内容查找
+            uint32_t InternContent(std::string_view s, std::string &out)
+            {
+                auto it = strings_.find(s);
+                if (it != strings_.end())
+                    return it->second;
+                uint32_t id = Define(s, out);
+                strings_.emplace(std::string(s), id);
+                return id;
+            }
+
+            uint32_t Define(std::string_view s, std::string &out)
+            {
+                uint32_t id = next_id_++;
+                out.push_back(static_cast<char>(ENTRY_STRING));
+                PutVarint(out, id);
+                PutVarint(out, s.size());
+                out.append(s.data(), s.size());
+                return id;
+            }
+
+            std::unordered_map<const char *, uint32_t> pointers_;
+            std::map<std::string, uint32_t, std::less<>> strings_;
+            uint32_t next_id_ = 0;
+            int64_t last_time_ = 0;
+            bool started_ = false;
+        };
+
+        // 解码后的一条记录，字符串指向Decoder内部，下一次Next之前有效
+        struct Record
+        {
+            LogLevel::value level;
+            time_t ctime;
+            const std::string *logger;
+            const std::string *file;
+            const std::string *tid;
+            const std::string *format;
+            size_t line;
+            int argc;
+            std::string args; // 参数按Deferred的内存编码重新排列，可直接交给Renderer
+        };
+
+        class Decoder
+        {
+        public:
+            enum Result { RECORD, TEXT, END, CORRUPT };
+
+            Decoder(const char *data, size_t len) : p_(data), end_(data + len) {}
+
+            // 读取下一个记录或文本条目，字符串定义和MAGIC在内部处理
+            Result Next(Record &rec, std::string_view &text)
+            {
+                while (p_ < end_)
+                {
+                    uint8_t type = static_cast<uint8_t>(*p_);
+                    if (type == ENTRY_MAGIC)
+                    {
+                        if (static_cast<size_t>(end_ - p_) < sizeof(magic) ||
+                            memcmp(p_, magic, sizeof(magic)) != 0)
+                            return CORRUPT;
+                        p_ += sizeof(magic);
+                        strings_.clear();
+                        last_time_ = 0;
+                        continue;
+                    }
+                    ++p_;
+                    if (type == ENTRY_STRING)
+                    {
+                        uint64_t id, n;
+                        if (!GetVarint(p_, end_, id) || !GetVarint(p_, end_, n) ||
+                            n > static_cast<uint64_t>(end_ - p_) || id > strings_.size())
+                            return CORRUPT;
+                        if (id == strings_.size())
+                            strings_.emplace_back(p_, n);
+                        else
+                            strings_[id].assign(p_, n);
+                        p_ += n;
+                        continue;
+                    }
+                    if (type == ENTRY_TEXT)
+                    {
+                        uint64_t n;
+                        if (!GetVarint(p_, end_, n) || n > static_cast<uint64_t>(end_ - p_))
+                            return CORRUPT;
+                        text = std::string_view(p_, n);
+                        p_ += n;
+                        return TEXT;
+                    }
+                    if (type == ENTRY_RECORD)
+                        return DecodeRecord(rec) ? RECORD : CORRUPT;
+                    return CORRUPT;
+                }
+                return END;
+            }
+
+            size_t Offset(const char *begin) const { return p_ - begin; }
+
+        private:
+            bool DecodeRecord(Record &rec)
+            {
+                if (p_ >= end_)
+                    return false;
+                rec.level = static_cast<LogLevel::value>(*p_++);
+                uint64_t delta, logger, file, line, tid, format, argc;
+                if (!GetVarint(p_, end_, delta) || !GetVarint(p_, end_, logger) ||
+                    !GetVarint(p_, end_, file) || !GetVarint(p_, end_, line) ||
+                    !GetVarint(p_, end_, tid) || !GetVarint(p_, end_, format) ||
+                    !GetVarint(p_, end_, argc))
+                    return false;
+                if (logger >= strings_.size() || file >= strings_.size() ||
+                    tid >= strings_.size() || format >= strings_.size())
+                    return false;
+                last_time_ += UnZigZag(delta);
+                rec.ctime = static_cast<time_t>(last_time_);
+                rec.logger = &strings_[logger];
+                rec.file = &strings_[file];
+                rec.line = line;
+                rec.tid = &strings_[tid];
+                rec.format = &strings_[format];
+                rec.argc = static_cast<int>(argc);
+
+                rec.args.clear();
+                for (uint64_t i = 0; i < argc; ++i)
+                {
+                    if (p_ >= end_)
+                        return false;
+                    auto c = static_cast<Deferred::Category>(*p_++);
+                    rec.args.push_back(static_cast<char>(c));
+                    if (c == Deferred::Category::STRING)
+                    {
+                        uint64_t n;
+                        if (!GetVarint(p_, end_, n) || n > static_cast<uint64_t>(end_ - p_))
+                            return false;
+                        Deferred::Put(rec.args, static_cast<uint32_t>(n));
+                        rec.args.append(p_, n);
+                        p_ += n;
+                        continue;
+                    }
+                    uint64_t v;
+                    if (c == Deferred::Category::FLOAT)
+                    {
+                        if (end_ - p_ < static_cast<ptrdiff_t>(sizeof(v)))
+                            return false;
+                        memcpy(&v, p_, sizeof(v));
+                        p_ += sizeof(v);
+                    }
+                    else
+                    {
+                        if (!GetVarint(p_, end_, v))
+                            return false;
+                        if (c == Deferred::Category::INT)
+                            v = static_cast<uint64_t>(UnZigZag(v));
+                    }
+                    Deferred::Put(rec.args, v);
+                }
+                return true;
+            }
+
+            const char *p_;
+            const char *end_;
+            std::vector<std::string> strings_;
+            int64_t last_time_ = 0;
+        };
+    } // namespace Binary
+} // namespace mylog
@@ -0,0 +1,436 @@
+/*延迟格式化：调用线程只保存参数，后台线程再按格式串生成文本*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "Level.hpp"
+#include "Message.hpp"
+
+namespace mylog
+{
+    namespace Deferred
+    {
+        // 记录以'\0'开头，格式化好的文本日志里不会出现'\0'，
+        // 后台线程据此在同一块缓冲区里区分两种数据
+        constexpr char record_tag = '\0';
+
+        enum class Category : uint8_t { INT, UINT, FLOAT, CSTRING, STRING, POINTER, OTHER };
+
+        template <typename... Args>
+        struct TypeList {};
+        // 只在decltype中使用，得到参数退化后的类型列表
+        template <typename... Args>
+        TypeList<std::decay_t<Args>...> ArgTypes(Args &&...);
+
+        template <typename T>
+        constexpr Category CategoryOf()
+        {
+            if (std::is_same<T, char *>::value || std::is_same<T, const char *>::value)
+                return Category::CSTRING;
+            if (std::is_same<T, std::string>::value || std::is_same<T, std::string_view>::value)
+                return Category::STRING;
+            if (std::is_floating_point<T>::value)
+                return Category::FLOAT;
+            if (std::is_enum<T>::value || (std::is_integral<T>::value && std::is_signed<T>::value))
+                return Category::INT;
+            if (std::is_integral<T>::value)
+                return Category::UINT;
+            if (std::is_pointer<T>::value || std::is_null_pointer<T>::value)
+                return Category::POINTER;
+            return Category::OTHER;
+        }
+
+        constexpr bool Compatible(char conv, Category c)
+        {
+            switch (conv)
+            {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                return c == Category::INT || c == Category::UINT;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                return c == Category::FLOAT;
+            case 's':
+                return c == Category::CSTRING || c == Category::STRING;
+            case 'p':
+                return c == Category::POINTER;
+            default:
+                return false;
+            }
+        }
+
+        // 参数和转换字符对不上时(格式串未经编译期检查)使用的转换字符
+        constexpr char DefaultConv(Category c)
+        {
+            switch (c)
+            {
+            case Category::INT: return 'd';
+            case Category::UINT: return 'u';
+            case Category::FLOAT: return 'g';
+            case Category::POINTER: return 'p';
+            default: return 's';
+            }
+        }
+
+        // 一个转换说明 %[flags][width][.precision][length]conv 的解析结果，
+        // 长度修饰符被丢弃，后台线程按参数实际保存的类型重新补上
+        struct Spec
+        {
+            const char *begin = nullptr; // 指向'%'
+            const char *flags_end = nullptr; // flags和width结束的位置
+            const char *end = nullptr; // 转换字符之后
+            int precision = -1;
+            char conv = 0;
+            bool valid = false;
+        };
+
+        constexpr Spec ParseSpec(const char *p)
+        {
+            Spec s;
+            s.begin = p++;
+            while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+                ++p;
+            while (*p >= '0' && *p <= '9')
+                ++p;
+            s.flags_end = p;
+            if (*p == '.')
+            {
+                ++p;
+                s.precision = 0;
+                while (*p >= '0' && *p <= '9')
+                    s.precision = s.precision * 10 + (*p++ - '0');
+            }
+            while (*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't' || *p == 'L')
+                ++p;
+            s.conv = *p;
+            s.end = *p ? p + 1 : p;
+            // '*'宽度、%n等不支持，Compatible里一律判为不匹配
+            s.valid = *p != 0 && *p != '*';
+            return s;
+        }
+
+        // 编译期检查格式串里的转换说明和参数类型、个数是否一致
+        template <typename... Args>
+        constexpr bool Check(const char *fmt, TypeList<Args...>)
+        {
+            constexpr Category cats[] = {CategoryOf<Args>()..., Category::OTHER};
+            size_t n = 0;
+            for (const char *p = fmt; *p;)
+            {
+                if (*p != '%')
+                {
+                    ++p;
+                    continue;
+                }
+                if (p[1] == '%')
+                {
+                    p += 2;
+                    continue;
+                }
+                Spec s = ParseSpec(p);
+                if (!s.valid || n >= sizeof...(Args) || !Compatible(s.conv, cats[n]))
+                    return false;
+                ++n;
+                p = s.end;
+            }
+            return n == sizeof...(Args);
+        }
+
+        // 记录头，后面依次是线程id和参数。file、format必须是字符串字面量，
+        // 只保存指针
+        struct RecordHeader
+        {
+            char tag;
+            uint8_t level;
+            uint8_t argc;
+            uint8_t tid_len;
+            uint32_t size; // 整条记录的字节数
+            time_t ctime;
+            size_t line;
+            const char *file;
+            const char *format;
+        };
+
+        template <typename T>
+        void Put(std::string &out, const T &value)
+        {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        inline void PutString(std::string &out, const char *data, size_t len)
+        {
+            out.push_back(static_cast<char>(Category::STRING));
+            Put(out, static_cast<uint32_t>(len));
+            out.append(data, len);
+        }
+
+        inline void PutCString(std::string &out, const char *s)
+        {
+            if (s == nullptr)
+                s = "(null)";
+            PutString(out, s, strlen(s));
+        }
+
+        template <typename T>
+        void EncodeArg(std::string &out, const T &value)
+        {
+            constexpr Category c = CategoryOf<std::decay_t<T>>();
+            static_assert(c != Category::OTHER, "unsupported log argument type");
+            if constexpr (c == Category::CSTRING)
+            {
+                PutCString(out, value);
+            }
+            else if constexpr (c == Category::STRING)
+            {
+                PutString(out, value.data(), value.size());
+            }
+            else if constexpr (c == Category::INT)
+            {
+                out.push_back(static_cast<char>(c));
+                Put(out, static_cast<int64_t>(value));
+            }
+            else if constexpr (c == Category::UINT)
+            {
+                out.push_back(static_cast<char>(c));
+                Put(out, static_cast<uint64_t>(value));
+            }
+            else if constexpr (c == Category::FLOAT)
+            {
+                out.push_back(static_cast<char>(c));
+                Put(out, static_cast<double>(value));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(c));
+                Put(out, reinterpret_cast<uintptr_t>(static_cast<const void *>(value)));
+            }
+        }
+
+        // 在调用线程上把一条日志编码进out，返回的视图在本线程下一次编码前有效
+        template <typename... Args>
+        std::string_view Encode(LogLevel::value level, const char *file, size_t line,
+                                const char *format, const Args &...args)
+        {
+            static_assert(sizeof...(Args) < 256, "too many log arguments");
+            thread_local std::string out;
+            const std::string &tid = LogMessage::ThreadId();
+            RecordHeader h;
+            h.tag = record_tag;
+            h.level = static_cast<uint8_t>(level);
+            h.argc = sizeof...(Args);
+            h.tid_len = static_cast<uint8_t>(tid.size());
+            h.size = 0;
+            h.ctime = Util::Date::Now();
+            h.line = line;
+            h.file = file;
+            h.format = format;
+
+            out.clear();
+            Put(out, h);
+            out.append(tid.data(), h.tid_len);
+            (EncodeArg(out, args), ...);
+            uint32_t size = static_cast<uint32_t>(out.size());
+            memcpy(&out[offsetof(RecordHeader, size)], &size, sizeof(size));
+            return std::string_view(out.data(), out.size());
+        }
+
+        // 缓冲区中一条记录的解析结果
+        struct RecordView
+        {
+            RecordHeader header;
+            std::string_view tid;
+            const char *args; // 第一个参数的编码
+            const char *end;  // 记录结束位置
+        };
+
+        // 解析data开头的一条记录，记录不完整时返回false
+        inline bool Parse(const char *data, size_t len, RecordView &r)
+        {
+            if (len < sizeof(RecordHeader))
+                return false;
+            memcpy(&r.header, data, sizeof(RecordHeader));
+            if (r.header.size < sizeof(RecordHeader) + r.header.tid_len || r.header.size > len)
+                return false;
+            const char *p = data + sizeof(RecordHeader);
+            r.tid = std::string_view(p, r.header.tid_len);
+            r.args = p + r.header.tid_len;
+            r.end = data + r.header.size;
+            return true;
+        }
+
+        class Renderer
+        {
+        public:
+            // 把data开头的一条记录渲染成文本追加到out，返回记录长度
+            size_t Render(const char *data, size_t len, const std::string &name, std::string &out)
+            {
+                RecordView r;
+                if (!Parse(data, len, r))
+                    return len; // 记录不完整，丢弃剩余数据
+
+                const RecordHeader &h = r.header;
+                LogMessage msg(static_cast<LogLevel::value>(h.level), h.file, h.line,
+                               name, h.ctime, r.tid);
+                size_t old = out.size();
+                out.resize(old + msg.HeaderSize());
+                out.resize(old + msg.FormatHeader(&out[old]));
+                RenderPayload(h.format, h.argc, r.args, r.end, out);
+                out.push_back('\n');
+                return h.size;
+            }
+
+            // 按格式串渲染[p, end)中编码的argc个参数，追加到out
+            void RenderPayload(const char *format, int argc, const char *p, const char *end,
+                               std::string &out)
+            {
+                int left = argc;
+                const char *f = format;
+                while (*f)
+                {
+                    const char *pct = strchr(f, '%');
+                    if (pct == nullptr)
+                    {
+                        out.append(f);
+                        break;
+                    }
+                    out.append(f, pct - f);
+                    if (pct[1] == '%')
+                    {
+                        out.push_back('%');
+                        f = pct + 2;
+                        continue;
+                    }
+                    Spec s = ParseSpec(pct);
+                    if (!s.valid || left == 0 || p >= end)
+                    { // 未经检查的格式串，参数不够时原样输出
+                        out.append(pct, s.end - pct);
+                        f = s.end;
+                        continue;
+                    }
+                    p = RenderArg(s, p, end, out);
+                    --left;
+                    f = s.end;
+                }
+            }
+
+        private:
+            const char *RenderArg(const Spec &s, const char *p, const char *end, std::string &out)
+            {
+                Category c = static_cast<Category>(*p++);
+                char conv = Compatible(s.conv, c) ? s.conv : DefaultConv(c);
+                bool plain = s.flags_end == s.begin + 1 && s.precision < 0;
+                if (plain && c == Category::STRING)
+                { // 最常见的%s和%d直接追加，不经过snprintf
+                    uint32_t len;
+                    memcpy(&len, p, sizeof(len));
+                    p += sizeof(len);
+                    if (len > static_cast<size_t>(end - p))
+                        len = end - p;
+                    out.append(p, len);
+                    return p + len;
+                }
+                if (plain && (c == Category::INT || c == Category::UINT) &&
+                    (conv == 'd' || conv == 'i' || conv == 'u'))
+                {
+                    uint64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    bool negative = c == Category::INT && static_cast<int64_t>(v) < 0;
+                    if (negative)
+                    {
+                        out.push_back('-');
+                        v = 0 - v;
+                    }
+                    char tmp[24];
+                    char *cur = tmp + sizeof(tmp);
+                    do
+                    {
+                        *--cur = static_cast<char>('0' + v % 10);
+                        v /= 10;
+                    } while (v != 0);
+                    out.append(cur, tmp + sizeof(tmp) - cur);
+                    return p + sizeof(v);
+                }
+                // 重新拼出转换说明: flags/width + 精度 + 与保存类型一致的长度修饰符 + 转换字符
+                std::string_view head(s.begin, s.flags_end - s.begin);
+                char spec[48];
+                size_t n = head.size() < 32 ? head.size() : 32;
+                memcpy(spec, head.data(), n);
+                if (c == Category::STRING)
+                {
+                    uint32_t len;
+                    memcpy(&len, p, sizeof(len));
+                    p += sizeof(len);
+                    if (len > static_cast<size_t>(end - p))
+                        len = end - p;
+                    int prec = len;
+                    if (s.precision >= 0 && s.precision < prec)
+                        prec = s.precision;
+                    memcpy(spec + n, ".*s", 4);
+                    Append(out, spec, prec, p);
+                    return p + len;
+                }
+                if (s.precision >= 0)
+                    n += snprintf(spec + n, 12, ".%d", s.precision);
+                if (c == Category::INT || c == Category::UINT)
+                {
+                    uint64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    if (conv == 'c')
+                    {
+                        spec[n++] = 'c';
+                        spec[n] = 0;
+                        Append(out, spec, static_cast<int>(v));
+                    }
+                    else
+                    {
+                        spec[n++] = 'l';
+                        spec[n++] = 'l';
+                        spec[n++] = conv;
+                        spec[n] = 0;
+                        if (c == Category::INT)
+                            Append(out, spec, static_cast<long long>(v));
+                        else
+                            Append(out, spec, static_cast<unsigned long long>(v));
+                    }
+                    return p + sizeof(v);
+                }
+                if (c == Category::FLOAT)
+                {
+                    double v;
+                    memcpy(&v, p, sizeof(v));
+                    spec[n++] = conv;
+                    spec[n] = 0;
+                    Append(out, spec, v);
+                    return p + sizeof(v);
+                }
+                uintptr_t v;
+                memcpy(&v, p, sizeof(v));
+                spec[n++] = 'p';
+                spec[n] = 0;
+                Append(out, spec, reinterpret_cast<void *>(v));
+                return p + sizeof(v);
+            }
+
+            template <typename... Args>
+            static void Append(std::string &out, const char *spec, Args... args)
+            {
+                char tmp[128];
+                int n = snprintf(tmp, sizeof(tmp), spec, args...);
+                if (n < 0)
+                    return;
+                if (static_cast<size_t>(n) < sizeof(tmp))
+                {
+                    out.append(tmp, n);
+                    return;
+                }
+                size_t old = out.size();
+                out.resize(old + n + 1);
+                snprintf(&out[old], n + 1, spec, args...);
+                out.resize(old + n);
+            }
+        };
+    } // namespace Deferred
+} // namespace mylog
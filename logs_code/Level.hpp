@@ -24,5 +24,17 @@ class LogLevel {
         }
         return "UNKNOW";
     }
+    // 配置文件中的等级名转换为枚举，不认识的名字返回false
+    static bool FromString(const std::string& name, value& level) {
+        static const value all[] = {value::DEBUG, value::INFO, value::WARN, value::ERROR,
+                                    value::FATAL};
+        for (value v : all) {
+            if (name == ToString(v)) {
+                level = v;
+                return true;
+            }
+        }
+        return false;
+    }
 };
 }  // namespace mylog
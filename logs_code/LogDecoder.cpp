@@ -0,0 +1,191 @@
+// 二进制日志解码工具：把FileFlush/RollFileFlush以LogFormat::BINARY写出的文件还原为文本或JSON
+// 编译: g++ -std=c++17 -O2 LogDecoder.cpp -o LogDecoder
+// 用法: LogDecoder [--json] file...
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "BinaryLog.hpp"
+
+void usage(const char *procgress)
+{
+    fprintf(stderr, "usage: %s [--json] file...\n", procgress);
+}
+
+// 按JSON字符串的规则转义后追加
+void append_json(std::string &out, std::string_view s)
+{
+    out.push_back('"');
+    for (char ch : s)
+    {
+        switch (ch)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                out += buf;
+            }
+            else
+            {
+                out.push_back(ch);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+void render_text(const mylog::Binary::Record &rec, std::string &out)
+{
+    mylog::LogMessage msg(rec.level, rec.file->c_str(), rec.line, *rec.logger,
+                          rec.ctime, *rec.tid);
+    size_t old = out.size();
+    out.resize(old + msg.HeaderSize());
+    out.resize(old + msg.FormatHeader(&out[old]));
+    mylog::Deferred::Renderer().RenderPayload(rec.format->c_str(), rec.argc, rec.args.data(),
+                                              rec.args.data() + rec.args.size(), out);
+    out.push_back('\n');
+}
+
+void render_json(const mylog::Binary::Record &rec, std::string &out)
+{
+    std::string message;
+    mylog::Deferred::Renderer().RenderPayload(rec.format->c_str(), rec.argc, rec.args.data(),
+                                              rec.args.data() + rec.args.size(), message);
+    out += "{\"time\":" + std::to_string(rec.ctime);
+    out += ",\"level\":\"";
+    out += mylog::LogLevel::ToString(rec.level);
+    out += "\",\"logger\":";
+    append_json(out, *rec.logger);
+    out += ",\"tid\":";
+    append_json(out, *rec.tid);
+    out += ",\"file\":";
+    append_json(out, *rec.file);
+    out += ",\"line\":" + std::to_string(rec.line);
+    out += ",\"format\":";
+    append_json(out, *rec.format);
+    out += ",\"message\":";
+    append_json(out, message);
+    out += "}\n";
+}
+
+// 文本条目可能包含多行，JSON模式下每行输出一个对象
+void text_json(std::string_view text, std::string &out)
+{
+    while (!text.empty())
+    {
+        size_t pos = text.find('\n');
+        std::string_view line = text.substr(0, pos);
+        out += "{\"text\":";
+        append_json(out, line);
+        out += "}\n";
+        if (pos == std::string_view::npos)
+            break;
+        text.remove_prefix(pos + 1);
+    }
+}
+
+bool decode_file(const char *filename, bool json)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror(filename);
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        perror(filename);
+        return false;
+    }
+
+    const char *begin = static_cast<const char *>(addr);
+    mylog::Binary::Decoder decoder(begin, st.st_size);
+    mylog::Binary::Record rec;
+    std::string_view text;
+    std::string out;
+    bool ok = true;
+    while (true)
+    {
+        auto r = decoder.Next(rec, text);
+        if (r == mylog::Binary::Decoder::END)
+            break;
+        if (r == mylog::Binary::Decoder::CORRUPT)
+        {
+            fprintf(stderr, "%s: corrupt entry at offset %zu\n", filename, decoder.Offset(begin));
+            ok = false;
+            break;
+        }
+        if (r == mylog::Binary::Decoder::TEXT)
+        {
+            if (json)
+                text_json(text, out);
+            else
+                out.append(text.data(), text.size());
+        }
+        else if (json)
+        {
+            render_json(rec, out);
+        }
+        else
+        {
+            render_text(rec, out);
+        }
+        if (out.size() >= 64 * 1024)
+        {
+            fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    munmap(addr, st.st_size);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "--json") == 0)
+    {
+        json = true;
+        first = 2;
+    }
+    if (first >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for (int i = first; i < argc; ++i)
+    {
+        if (!decode_file(argv[i], json))
+            ret = 1;
+    }
+    return ret;
+}
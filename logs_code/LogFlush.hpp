@@ -2,7 +2,16 @@
 #include <fstream>
 #include <memory>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "Util.hpp"
+#include "BinaryLog.hpp"
 
 extern mylog::Util::JsonData* g_conf_data;
 namespace mylog{
@@ -12,6 +21,42 @@ namespace mylog{
         using ptr = std::shared_ptr<LogFlush>;
         virtual ~LogFlush() {}
         virtual void Flush(const char *data, size_t len) = 0;//不同的写文件方式Flush的实现不同
+
+        // 二进制格式的落地方式接收未渲染的原始数据，由编码器转换后再交给Flush
+        bool Binary() const { return encoder_ != nullptr; }
+        virtual void FlushBinary(const std::string &logger, const char *data, size_t len)
+        {
+            encoded_.clear();
+            encoder_->Encode(logger, data, len, encoded_);
+            Flush(encoded_.data(), encoded_.size());
+        }
+
+    protected:
+        void SetFormat(LogFormat format)
+        {
+            if (format == LogFormat::BINARY)
+                encoder_.reset(new Binary::Encoder);
+        }
+
+        // 滚动日志文件名: 基础名 + 时间 + 序号 + 后缀
+        std::string RollFilename(const std::string &basename, size_t cnt) const
+        {
+            time_t time_ = Util::Date::Now();
+            struct tm t;
+            localtime_r(&time_, &t);
+            std::string filename = basename;
+            filename += std::to_string(t.tm_year + 1900);
+            filename += std::to_string(t.tm_mon + 1);
+            filename += std::to_string(t.tm_mday);
+            filename += std::to_string(t.tm_hour + 1);
+            filename += std::to_string(t.tm_min + 1);
+            filename += std::to_string(t.tm_sec + 1) + '-' +
+                        std::to_string(cnt) + (encoder_ ? ".bin" : ".log");
+            return filename;
+        }
+
+        std::unique_ptr<Binary::Encoder> encoder_;
+        std::string encoded_;
     };
 
     class StdoutFlush : public LogFlush
@@ -26,8 +71,10 @@ namespace mylog{
     {
     public:
         using ptr = std::shared_ptr<FileFlush>;
-        FileFlush(const std::string &filename) : filename_(filename)
+        FileFlush(const std::string &filename, LogFormat format = LogFormat::TEXT)
+            : filename_(filename)
         {
+            SetFormat(format);
             // 创建所给目录
             Util::File::CreateDirectory(Util::File::Path(filename));
             // 打开文件
@@ -63,12 +110,27 @@ namespace mylog{
     {
     public:
         using ptr = std::shared_ptr<RollFileFlush>;
-        RollFileFlush(const std::string &filename, size_t max_size)
+        RollFileFlush(const std::string &filename, size_t max_size,
+                      LogFormat format = LogFormat::TEXT)
             : max_size_(max_size), basename_(filename)
         {
+            SetFormat(format);
             Util::File::CreateDirectory(Util::File::Path(filename));
         }
 
+        ~RollFileFlush()
+        {
+            if (fs_ != NULL)
+                fclose(fs_);
+        }
+
+        void FlushBinary(const std::string &logger, const char *data, size_t len) override
+        {
+            // 先决定是否换文件，新文件要从MAGIC和字符串定义重新开始
+            InitLogFile();
+            LogFlush::FlushBinary(logger, data, len);
+        }
+
         void Flush(const char *data, size_t len) override
         {
             // 确认文件大小不满足滚动需求
@@ -107,24 +169,15 @@ namespace mylog{
                     perror(NULL);
                 }
                 cur_size_ = 0;
+                if (encoder_)
+                    encoder_->Reset();
             }
         }
 
         // 构建落地的滚动日志文件名称
         std::string CreateFilename()
         {
-            time_t time_ = Util::Date::Now();
-            struct tm t;
-            localtime_r(&time_, &t);
-            std::string filename = basename_;
-            filename += std::to_string(t.tm_year + 1900);
-            filename += std::to_string(t.tm_mon + 1);
-            filename += std::to_string(t.tm_mday);
-            filename += std::to_string(t.tm_hour + 1);
-            filename += std::to_string(t.tm_min + 1);
-            filename += std::to_string(t.tm_sec + 1) + '-' +
-                        std::to_string(cnt_++) + ".log";
-            return filename;
+            return RollFilename(basename_, cnt_++);
         }
 
     private:
@@ -136,6 +189,203 @@ namespace mylog{
         FILE* fs_ = NULL;
     };
 
+    // 滚动文件的后台写入版本：Flush只把数据追加到待写队列，由专门的写线程
+    // 成批pwrite，并提前用fallocate预分配空间。flush_log为2时不再每批fsync，
+    // 而是累计到一定字节数或时间间隔后做一次fdatasync(组提交)，
+    // 调用Flush的异步工作器线程不会因为刷盘而阻塞。
+    class AsyncRollFileFlush : public LogFlush
+    {
+    public:
+        using ptr = std::shared_ptr<AsyncRollFileFlush>;
+        static constexpr size_t batch_bytes = 1 << 20;     // 积累到该大小立即唤醒写线程
+        static constexpr size_t max_pending = 64 << 20;    // 待写数据上限，超过时Flush等待
+        static constexpr size_t prealloc_bytes = 16 << 20; // 每次预分配的空间
+        static constexpr size_t sync_bytes = 8 << 20;      // 未同步数据达到该大小就fdatasync
+        static constexpr int sync_interval_ms = 100;       // 最长同步间隔
+
+        AsyncRollFileFlush(const std::string &filename, size_t max_size,
+                           LogFormat format = LogFormat::TEXT)
+            : max_size_(max_size), basename_(filename)
+        {
+            SetFormat(format);
+            Util::File::CreateDirectory(Util::File::Path(filename));
+            chunks_.emplace_back(Chunk{std::string(), true}); // 第一个文件由写线程打开
+            thread_ = std::thread(&AsyncRollFileFlush::ThreadEntry, this);
+        }
+        ~AsyncRollFileFlush()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stop_ = true;
+            }
+            cond_writer_.notify_one();
+            thread_.join();
+        }
+
+        void Flush(const char *data, size_t len) override
+        {
+            // 在提交端决定换文件的位置，二进制格式据此重置编码器
+            bool roll = submitted_ >= max_size_;
+            if (roll)
+                submitted_ = 0;
+            submitted_ += len;
+
+            size_t pending;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cond_space_.wait(lock, [&]() { return pending_ < max_pending; });
+                if (roll || chunks_.empty())
+                    chunks_.emplace_back(Chunk{std::string(), roll});
+                chunks_.back().data.append(data, len);
+                pending_ += len;
+                pending = pending_;
+            }
+            if (pending >= batch_bytes)
+                cond_writer_.notify_one();
+        }
+
+        void FlushBinary(const std::string &logger, const char *data, size_t len) override
+        {
+            if (submitted_ >= max_size_)
+                encoder_->Reset(); // 与Flush中的判断一致，新文件从MAGIC开始
+            LogFlush::FlushBinary(logger, data, len);
+        }
+
+    private:
+        struct Chunk
+        {
+            std::string data;
+            bool roll; // 写入前先换一个新文件
+        };
+
+        void ThreadEntry()
+        {
+            std::vector<Chunk> batch;
+            while (true)
+            {
+                bool stop;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    cond_writer_.wait_for(lock, std::chrono::milliseconds(sync_interval_ms),
+                                          [&]() { return stop_ || pending_ >= batch_bytes; });
+                    batch.swap(chunks_);
+                    pending_ = 0;
+                    stop = stop_;
+                }
+                cond_space_.notify_all();
+                for (auto &chunk : batch)
+                {
+                    if (chunk.roll)
+                        Roll();
+                    Write(chunk.data.data(), chunk.data.size());
+                }
+                batch.clear();
+                Sync(stop);
+                if (stop)
+                    break;
+            }
+            Close();
+        }
+
+        void Close()
+        {
+            if (fd_ < 0)
+                return;
+            Sync(true);
+            if (allocated_ > offset_ && ftruncate(fd_, offset_) < 0) // 释放预分配但没用到的空间
+                perror("ftruncate log file failed: ");
+            close(fd_);
+            fd_ = -1;
+        }
+
+        void Roll()
+        {
+            Close();
+            std::string filename = RollFilename(basename_, cnt_++);
+            fd_ = open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd_ < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "open file failed" << std::endl;
+                perror(NULL);
+            }
+            struct stat st;
+            offset_ = (fd_ >= 0 && fstat(fd_, &st) == 0) ? st.st_size : 0;
+            allocated_ = offset_;
+        }
+
+        void Write(const char *data, size_t len)
+        {
+            if (fd_ < 0 || len == 0)
+                return;
+            if (offset_ + len > allocated_ && can_fallocate_)
+            {
+                // KEEP_SIZE只分配块不改变文件长度，读日志的程序看不到未写的部分；
+                // 不超过滚动大小，关闭文件时再截掉多余的块
+                size_t size = std::max(len, std::min(prealloc_bytes, max_size_ - std::min(max_size_, allocated_)));
+                if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated_, size) == 0)
+                    allocated_ += size;
+                else
+                    can_fallocate_ = false; // 文件系统不支持时不再尝试
+            }
+            while (len > 0)
+            {
+                ssize_t n = pwrite(fd_, data, len, offset_);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    std::cout << __FILE__ << __LINE__ << "write log file failed" << std::endl;
+                    perror(NULL);
+                    return;
+                }
+                data += n;
+                len -= n;
+                offset_ += n;
+                unsynced_ += n;
+            }
+        }
+
+        // 组提交: 累计的未同步数据足够多或距上次同步足够久才fdatasync
+        void Sync(bool force)
+        {
+            if (fd_ < 0 || unsynced_ == 0 || g_conf_data->flush_log != 2)
+                return;
+            auto now = std::chrono::steady_clock::now();
+            if (!force && unsynced_ < sync_bytes &&
+                now - last_sync_ < std::chrono::milliseconds(sync_interval_ms))
+                return;
+            if (fdatasync(fd_) < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "fdatasync file failed" << std::endl;
+                perror(NULL);
+            }
+            unsynced_ = 0;
+            last_sync_ = now;
+        }
+
+    private:
+        size_t max_size_;
+        std::string basename_;
+        size_t submitted_ = 0; // 当前文件已提交的字节数，只由调用Flush的线程访问
+
+        std::mutex mtx_;
+        std::condition_variable cond_writer_;
+        std::condition_variable cond_space_;
+        std::vector<Chunk> chunks_;
+        size_t pending_ = 0;
+        bool stop_ = false;
+
+        // 以下只由写线程访问
+        int fd_ = -1;
+        size_t cnt_ = 1;
+        size_t offset_ = 0;
+        size_t allocated_ = 0;
+        size_t unsynced_ = 0;
+        bool can_fallocate_ = true;
+        std::chrono::steady_clock::time_point last_sync_;
+        std::thread thread_;
+    };
+
     class LogFlushFactory
     {
     public:
@@ -1,47 +1,146 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 #include "Level.hpp"
 #include "Util.hpp"
 
 namespace mylog
 {
+  // 一条日志的元信息，只引用调用者的数据，不做拷贝。
+  // Format把整行 [时间][线程id][等级][日志器][文件:行号]\t内容\n
+  // 直接写进当前线程私有的缓冲区，稳定后每行日志没有堆分配。
   struct LogMessage
   {
-    using ptr = std::shared_ptr<LogMessage>;
-    LogMessage() = default;
-    LogMessage(LogLevel::value level, std::string file, size_t line,
-               std::string name, std::string payload)
-        : name_(name),
-          file_name_(file),
-          payload_(payload),
-          level_(level),
+    LogMessage(LogLevel::value level, const char *file, size_t line,
+               const std::string &name)
+        : LogMessage(level, file, line, name, Util::Date::Now(), ThreadId()) {}
+    // 延迟格式化时由后台线程使用，时间和线程id取自记录
+    LogMessage(LogLevel::value level, const char *file, size_t line,
+               const std::string &name, time_t ctime, std::string_view tid)
+        : level_(level),
           line_(line),
-          ctime_(Util::Date::Now()),
-          tid_(std::this_thread::get_id()) {}
+          ctime_(ctime),
+          file_name_(file),
+          file_len_(strlen(file)),
+          name_(name),
+          tid_(tid) {}
+
+    // 返回的视图在本线程下一次调用Format之前有效
+    std::string_view Format(const char *fmt, va_list va)
+    {
+      thread_local std::vector<char> buf(1024);
+      if (buf.size() < HeaderSize() + 128)
+        buf.resize(HeaderSize() + 128);
+      size_t len = FormatHeader(buf.data());
+
+      va_list copy;
+      va_copy(copy, va);
+      int n = vsnprintf(buf.data() + len, buf.size() - len, fmt, va);
+      if (n >= 0 && len + n + 1 >= buf.size())
+      { // 放不下时扩容后重新格式化，扩容后的缓冲区留给本线程后续使用
+        buf.resize(len + n + 2);
+        n = vsnprintf(buf.data() + len, buf.size() - len, fmt, copy);
+      }
+      va_end(copy);
+      if (n < 0)
+      {
+        perror("vsnprintf failed!!!: ");
+      }
+      else
+      {
+        // %c可能写出'\0'，文本中不能出现，'\0'是延迟格式化记录的起始标记
+        std::replace(buf.data() + len, buf.data() + len + n, '\0', ' ');
+        len += n;
+      }
+      buf[len++] = '\n';
+      return std::string_view(buf.data(), len);
+    }
+
+    // 日志头的最大长度: 时间11 + 线程id + 等级5 + 行号20 + 分隔符9
+    size_t HeaderSize() const
+    {
+      return 45 + tid_.size() + name_.size() + file_len_;
+    }
+
+    // 把日志头写入out，out至少要有HeaderSize()字节，返回实际长度
+    size_t FormatHeader(char *out)
+    {
+      // 时间部分每个线程每秒只格式化一次
+      thread_local time_t cached_sec = -1;
+      thread_local char cached_time[16];
+      if (ctime_ != cached_sec)
+      {
+        struct tm t;
+        localtime_r(&ctime_, &t);
+        snprintf(cached_time, sizeof(cached_time), "[%02d:%02d:%02d][",
+                 t.tm_hour, t.tm_min, t.tm_sec);
+        cached_sec = ctime_;
+      }
+      char *p = out;
+      p = Append(p, cached_time, 11);
+      p = Append(p, tid_.data(), tid_.size());
+      p = Append(p, "][", 2);
+      const char *level = LogLevel::ToString(level_);
+      p = Append(p, level, strlen(level));
+      p = Append(p, "][", 2);
+      p = Append(p, name_.data(), name_.size());
+      p = Append(p, "][", 2);
+      p = Append(p, file_name_, file_len_);
+      *p++ = ':';
+      p = AppendNumber(p, line_);
+      p = Append(p, "]\t", 2);
+      return p - out;
+    }
+
+    // 线程id的文本形式每个线程只生成一次
+    static const std::string &ThreadId()
+    {
+      thread_local std::string tid = []()
+      {
+        std::ostringstream ss;
+        ss << std::this_thread::get_id();
+        return ss.str();
+      }();
+      return tid;
+    }
 
-    std::string format()
+  private:
+    static char *Append(char *p, const char *data, size_t len)
     {
-      std::stringstream ret;
-      // 获取当前时间
-      struct tm t;
-      localtime_r(&ctime_, &t);
-      char buf[128];
-      strftime(buf, sizeof(buf), "%H:%M:%S", &t);
-      std::string tmp1 = '[' + std::string(buf) + "][";
-      std::string tmp2 = '[' + std::string(LogLevel::ToString(level_)) + "][" + name_ + "][" + file_name_ + ":" + std::to_string(line_) + "]\t" + payload_ + "\n";
-      ret << tmp1 << tid_ << tmp2;
-      return ret.str();
+      memcpy(p, data, len);
+      return p + len;
     }
 
+    static char *AppendNumber(char *p, size_t value)
+    {
+      char tmp[24];
+      char *end = tmp + sizeof(tmp);
+      char *cur = end;
+      do
+      {
+        *--cur = static_cast<char>('0' + value % 10);
+        value /= 10;
+      } while (value != 0);
+      return Append(p, cur, end - cur);
+    }
+
+    LogLevel::value level_; // 等级
     size_t line_;           // 行号
     time_t ctime_;          // 时间
-    std::string file_name_; // 文件名
-    std::string name_;      // 日志器名
-    std::string payload_;   // 信息体
-    std::thread::id tid_;   // 线程id
-    LogLevel::value level_; // 等级
+    const char *file_name_; // 文件名
+    size_t file_len_;
+    const std::string &name_; // 日志器名
+    std::string_view tid_;  // 线程id
   };
-} // namespace mylog
\ No newline at end of file
+} // namespace mylog
@@ -21,4 +21,19 @@ AsyncLogger::ptr DefaultLogger() { return LoggerManager::GetInstance().DefaultLo
 #define LOGWARNDEFAULT(fmt, ...) mylog::DefaultLogger()->Warn(fmt, ##__VA_ARGS__)
 #define LOGERRORDEFAULT(fmt, ...) mylog::DefaultLogger()->Error(fmt, ##__VA_ARGS__)
 #define LOGFATALDEFAULT(fmt, ...) mylog::DefaultLogger()->Fatal(fmt, ##__VA_ARGS__)
+
+// 延迟格式化: 编译期检查格式串和参数是否匹配，调用线程只保存参数，由后台线程格式化。
+// format必须是字符串字面量，参数支持整数、浮点、指针、const char*、std::string和std::string_view
+#define MYLOG_LOG(logger, level, format, ...)                                                  \
+    do {                                                                                       \
+        static_assert(mylog::Deferred::Check(format,                                           \
+                          decltype(mylog::Deferred::ArgTypes(__VA_ARGS__))()),                 \
+                      "log format string does not match its arguments");                      \
+        (logger)->Log(mylog::LogLevel::value::level, __FILE__, __LINE__, format, ##__VA_ARGS__); \
+    } while (0)
+#define MYLOG_DEBUG(logger, format, ...) MYLOG_LOG(logger, DEBUG, format, ##__VA_ARGS__)
+#define MYLOG_INFO(logger, format, ...) MYLOG_LOG(logger, INFO, format, ##__VA_ARGS__)
+#define MYLOG_WARN(logger, format, ...) MYLOG_LOG(logger, WARN, format, ##__VA_ARGS__)
+#define MYLOG_ERROR(logger, format, ...) MYLOG_LOG(logger, ERROR, format, ##__VA_ARGS__)
+#define MYLOG_FATAL(logger, format, ...) MYLOG_LOG(logger, FATAL, format, ##__VA_ARGS__)
 }  // namespace mylog
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <ctime>
 #include <fstream>
 #include <iostream>
+#include <vector>
 using std::cout;
 using std::endl;
 namespace mylog
@@ -144,6 +145,15 @@ namespace mylog
                 return false;
             }
         };
+        // 配置文件sinks数组中的一项，描述某个日志器的一个落地方向，由LoggerBuilder创建对应的LogFlush
+        struct SinkConf{
+            std::string logger;    // 日志器名，"*"匹配所有日志器
+            std::string type;      // stdout、file、roll、async_roll
+            std::string path;      // 文件名，滚动文件为文件名前缀
+            size_t max_size;       // 滚动文件的大小
+            std::string min_level; // 低于该等级的日志不交给这个落地方向
+            std::string format;    // text或binary
+        };
         struct JsonData{
             static JsonData* GetJsonData(){
                static JsonData* json_data = new JsonData;
@@ -166,6 +176,18 @@ namespace mylog
                 backup_addr = root["backup_addr"].asString();
                 backup_port = root["backup_port"].asInt();
                 thread_count = root["thread_count"].asInt();
+                backup_compress = root["backup_compress"].asBool();
+                for (const auto &sink : root["sinks"])
+                {
+                    SinkConf conf;
+                    conf.logger = sink["logger"].asString();
+                    conf.type = sink["type"].asString();
+                    conf.path = sink["path"].asString();
+                    conf.max_size = sink["max_size"].asUInt64();
+                    conf.min_level = sink.get("min_level", "DEBUG").asString();
+                    conf.format = sink.get("format", "text").asString();
+                    sinks.push_back(conf);
+                }
             }
             public:
                 size_t buffer_size;//缓冲区基础容量
@@ -175,6 +197,8 @@ namespace mylog
                 std::string backup_addr;
                 uint16_t backup_port;
                 size_t thread_count;
+                bool backup_compress;//远程备份是否压缩，需要以MYLOG_USE_ZLIB编译并链接-lz
+                std::vector<SinkConf> sinks;//按日志器配置的落地方向和等级过滤
         };
     } // namespace Util
 } // namespace mylog
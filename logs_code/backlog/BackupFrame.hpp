@@ -0,0 +1,130 @@
+// 远程备份的帧格式，发送端(CliBackupLog.hpp)和接收端(ServerBackupLog.hpp)共用
+// 每帧由12字节的帧头加负载组成，多字节整数均为网络字节序:
+//   type(1) flags(1) reserved(2) raw_len(4) payload_len(4)
+//   HELLO  负载为发送端的名字，每个连接建立后先发一帧，接收端据此区分来源
+//   DATA   负载为若干行完整的日志文本，flags带FLAG_ZLIB时负载经过zlib压缩，raw_len为压缩前长度
+#pragma once
+#include <arpa/inet.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef MYLOG_USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace mylog
+{
+    namespace Frame
+    {
+        constexpr size_t header_size = 12;
+        constexpr uint32_t max_payload = 16 * 1024 * 1024; // 超过该长度视为数据错误
+        enum Type : uint8_t
+        {
+            FRAME_HELLO = 1,
+            FRAME_DATA = 2
+        };
+        enum Flag : uint8_t
+        {
+            FLAG_ZLIB = 1
+        };
+
+        struct Header
+        {
+            uint8_t type;
+            uint8_t flags;
+            uint32_t raw_len;
+            uint32_t payload_len;
+        };
+
+        // buf至少有header_size字节
+        inline void EncodeHeader(char *buf, const Header &h)
+        {
+            memset(buf, 0, header_size);
+            buf[0] = static_cast<char>(h.type);
+            buf[1] = static_cast<char>(h.flags);
+            uint32_t raw = htonl(h.raw_len), payload = htonl(h.payload_len);
+            memcpy(buf + 4, &raw, 4);
+            memcpy(buf + 8, &payload, 4);
+        }
+
+        // data至少有header_size字节
+        inline bool GetHeader(const char *data, Header &h)
+        {
+            h.type = static_cast<uint8_t>(data[0]);
+            h.flags = static_cast<uint8_t>(data[1]);
+            uint32_t raw, payload;
+            memcpy(&raw, data + 4, 4);
+            memcpy(&payload, data + 8, 4);
+            h.raw_len = ntohl(raw);
+            h.payload_len = ntohl(payload);
+            if (h.type != FRAME_HELLO && h.type != FRAME_DATA)
+                return false;
+            if (h.payload_len > max_payload || h.raw_len > max_payload)
+                return false;
+#ifndef MYLOG_USE_ZLIB
+            if (h.flags & FLAG_ZLIB)
+                return false;
+#endif
+            return true;
+        }
+
+        // 把一帧追加到out，compress为true且压缩后更短时使用压缩的负载
+        inline void Append(std::string &out, Type type, const char *data, size_t len, bool compress = false)
+        {
+            Header h{static_cast<uint8_t>(type), 0, static_cast<uint32_t>(len), static_cast<uint32_t>(len)};
+#ifdef MYLOG_USE_ZLIB
+            if (compress && len > 0)
+            {
+                size_t old = out.size();
+                uLongf dest_len = compressBound(len);
+                out.resize(old + header_size + dest_len);
+                if (compress2(reinterpret_cast<Bytef *>(&out[old + header_size]), &dest_len,
+                              reinterpret_cast<const Bytef *>(data), len, Z_BEST_SPEED) == Z_OK &&
+                    dest_len < len)
+                {
+                    // 压缩数据已经在帧头之后，只需补上帧头
+                    h.flags = FLAG_ZLIB;
+                    h.payload_len = static_cast<uint32_t>(dest_len);
+                    EncodeHeader(&out[old], h);
+                    out.resize(old + header_size + dest_len);
+                    return;
+                }
+                out.resize(old);
+            }
+#else
+            (void)compress;
+#endif
+            size_t old = out.size();
+            out.resize(old + header_size);
+            EncodeHeader(&out[old], h);
+            out.append(data, len);
+        }
+
+        // 取出一帧的日志文本，未压缩时直接指向payload，失败返回false
+        inline bool Payload(const Header &h, const char *payload, std::string &buffer, const char *&data, size_t &len)
+        {
+            if (!(h.flags & FLAG_ZLIB))
+            {
+                data = payload;
+                len = h.payload_len;
+                return true;
+            }
+#ifdef MYLOG_USE_ZLIB
+            buffer.resize(h.raw_len);
+            uLongf dest_len = h.raw_len;
+            if (uncompress(reinterpret_cast<Bytef *>(&buffer[0]), &dest_len,
+                           reinterpret_cast<const Bytef *>(payload), h.payload_len) != Z_OK ||
+                dest_len != h.raw_len)
+                return false;
+            data = buffer.data();
+            len = buffer.size();
+            return true;
+#else
+            (void)buffer;
+            return false;
+#endif
+        }
+    } // namespace Frame
+} // namespace mylog
@@ -1,51 +1,594 @@
 // 远程备份debug等级以上的日志信息-发送端
+// 调用线程只把日志追加到内存队列，后台线程维持一条非阻塞的长连接，按批次组帧发送。
+// 接收端不可用时帧写入磁盘上的队列文件，重连后按原顺序补发，队列有容量上限，超出后丢弃并计数。
+// 补发到的位置记录在<队列文件>.offset中，进程重启后从该位置继续，已经发出的帧不会重复发送
+#pragma once
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include "../Util.hpp"
+#include "BackupFrame.hpp"
 
 extern mylog::Util::JsonData *g_conf_data;
-void start_backup(const std::string &message)
+
+namespace mylog
 {
-    // 1. create socket
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0)
-    {
-        std::cout << __FILE__ << __LINE__ << "socket error : " << strerror(errno) << std::endl;
-        perror(NULL);
-    }
-
-    struct sockaddr_in server;
-    memset(&server, 0, sizeof(server));
-    server.sin_family = AF_INET;
-    server.sin_port = htons(g_conf_data->backup_port);
-    inet_aton(g_conf_data->backup_addr.c_str(), &(server.sin_addr));
-
-    int cnt = 5;
-    while (-1 == connect(sock, (struct sockaddr *)&server, sizeof(server)))
+    class LogShipper
     {
-        std::cout << "正在尝试重连,重连次数还有: " << cnt-- << std::endl;
-        if (cnt <= 0)
+    public:
+        static constexpr size_t batch_bytes = 64 * 1024;          // 内存队列积累到该大小时立即发送
+        static constexpr int batch_interval_ms = 100;             // 否则最多等待该时间凑一批
+        static constexpr size_t max_memory = 4 * 1024 * 1024;     // 内存队列上限，超出丢弃
+        static constexpr size_t max_inflight = 4 * 1024 * 1024;   // 已组帧未发出的数据上限，超出写入磁盘队列
+        static constexpr size_t max_spool = 64 * 1024 * 1024;     // 磁盘队列上限
+        static constexpr size_t spool_chunk = 256 * 1024;         // 从磁盘队列每次读出的量
+        static constexpr int min_backoff_ms = 100;
+        static constexpr int max_backoff_ms = 30 * 1000;
+        static constexpr int connect_timeout_ms = 3 * 1000;       // 非阻塞连接的超时时间
+
+        struct Stats
         {
-            std::cout << __FILE__ << __LINE__ << "connect error : " << strerror(errno) << std::endl;
-            close(sock);
-            perror(NULL);
-            return;
+            uint64_t shipped_bytes = 0; // 已写入连接的日志字节数(压缩前)
+            uint64_t spooled_bytes = 0; // 写入磁盘队列的帧字节数
+            uint64_t dropped_lines = 0; // 内存队列或磁盘队列满时丢弃的日志
+            uint64_t connects = 0;      // 成功建立连接的次数
+        };
+
+        // 以配置文件中的backup_addr/backup_port发送，进程内共用一个实例
+        static LogShipper &GetInstance()
+        {
+            static LogShipper shipper(g_conf_data->backup_addr, g_conf_data->backup_port,
+                                      "./logfile/backup.spool", g_conf_data->backup_compress);
+            return shipper;
         }
-    }
 
-    // 3. 连接成功
-    char buffer[1024];
-    if (-1 == write(sock, message.c_str(), message.size()))
-    {
-        std::cout << __FILE__ << __LINE__ << "send to server error : " << strerror(errno) << std::endl;
-        perror(NULL);
-    }
-    close(sock);
-}
\ No newline at end of file
+        LogShipper(const std::string &addr, uint16_t port, const std::string &spool_path,
+                   bool compress = false)
+            : port_(port), compress_(compress), spool_path_(spool_path), source_(SourceName())
+        {
+            memset(&server_, 0, sizeof(server_));
+            server_.sin_family = AF_INET;
+            server_.sin_port = htons(port_);
+            if (inet_aton(addr.c_str(), &server_.sin_addr) == 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "invalid backup address: " << addr << std::endl;
+                return; // 不启动后台线程，Ship只丢弃
+            }
+            OpenSpool();
+            event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (event_fd_ < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "eventfd error : " << strerror(errno) << std::endl;
+                return;
+            }
+            thread_ = std::thread(&LogShipper::ThreadEntry, this);
+        }
+        ~LogShipper()
+        {
+            if (thread_.joinable())
+            {
+                stop_.store(true);
+                Notify();
+                thread_.join();
+            }
+            if (event_fd_ >= 0)
+                close(event_fd_);
+            if (spool_fd_ >= 0)
+                close(spool_fd_);
+            if (offset_fd_ >= 0)
+                close(offset_fd_);
+        }
+
+        // 不会阻塞调用者：只做一次加锁和追加，跨过批次阈值时写一次eventfd
+        void Ship(const char *data, size_t len)
+        {
+            if (len == 0)
+                return;
+            bool wake;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (!thread_.joinable() || pending_.size() + len > max_memory)
+                {
+                    dropped_lines_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                wake = pending_.size() < batch_bytes && pending_.size() + len >= batch_bytes;
+                pending_.append(data, len);
+            }
+            if (wake)
+                Notify();
+        }
+        void Ship(const std::string &message) { Ship(message.data(), message.size()); }
+
+        Stats GetStats() const
+        {
+            Stats s;
+            s.shipped_bytes = shipped_bytes_.load(std::memory_order_relaxed);
+            s.spooled_bytes = spooled_bytes_.load(std::memory_order_relaxed);
+            s.dropped_lines = dropped_lines_.load(std::memory_order_relaxed);
+            s.connects = connects_.load(std::memory_order_relaxed);
+            return s;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        static std::string SourceName()
+        {
+            char host[256] = {0};
+            gethostname(host, sizeof(host) - 1);
+            return host;
+        }
+
+        void Notify()
+        {
+            uint64_t one = 1;
+            if (write(event_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                perror("eventfd write failed: ");
+        }
+
+        void OpenSpool()
+        {
+            Util::File::CreateDirectory(Util::File::Path(spool_path_));
+            // 不截断，上次进程退出时没有发出的日志在这次启动后补发
+            spool_fd_ = open(spool_path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (spool_fd_ < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "open spool file failed : " << strerror(errno) << std::endl;
+                return;
+            }
+            struct stat st;
+            if (fstat(spool_fd_, &st) == 0)
+                spool_size_ = st.st_size;
+
+            // 上次补发到的位置，只会记录在帧边界上
+            offset_fd_ = open((spool_path_ + ".offset").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (offset_fd_ < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "open spool offset file failed : " << strerror(errno) << std::endl;
+                return;
+            }
+            uint64_t offset = 0;
+            if (pread(offset_fd_, &offset, sizeof(offset), 0) == sizeof(offset) && offset <= spool_size_)
+                spool_sent_ = spool_offset_ = offset;
+        }
+
+        void SaveSpoolOffset()
+        {
+            uint64_t offset = spool_sent_;
+            if (offset_fd_ >= 0 && pwrite(offset_fd_, &offset, sizeof(offset), 0) != sizeof(offset))
+                perror("write spool offset failed: ");
+        }
+
+        void ThreadEntry()
+        {
+            std::string batch;
+            auto last_batch = Clock::now();
+            while (true)
+            {
+                bool stop = stop_.load();
+                auto now = Clock::now();
+                // 取走内存队列，组成一帧
+                if (stop || now - last_batch >= std::chrono::milliseconds(batch_interval_ms) ||
+                    PendingSize() >= batch_bytes)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        batch.swap(pending_);
+                    }
+                    last_batch = now;
+                    if (!batch.empty())
+                        Enqueue(batch);
+                    batch.clear();
+                }
+                if (stop)
+                {
+                    Shutdown();
+                    return;
+                }
+                if (sock_ < 0 && now >= next_connect_)
+                    Connect();
+                else if (sock_ >= 0 && !connected_ && now >= connect_deadline_)
+                    Disconnect(); // 连接超时
+                if (connected_)
+                    FillFromSpool();
+
+                struct pollfd fds[2];
+                fds[0].fd = event_fd_;
+                fds[0].events = POLLIN;
+                fds[0].revents = 0;
+                int nfds = 1;
+                if (sock_ >= 0)
+                {
+                    fds[1].fd = sock_;
+                    fds[1].events = POLLIN;
+                    if (!connected_ || sent_ < out_.size())
+                        fds[1].events |= POLLOUT;
+                    fds[1].revents = 0;
+                    nfds = 2;
+                }
+                int timeout = batch_interval_ms;
+                if (sock_ < 0)
+                {
+                    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_connect_ - now).count();
+                    timeout = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(timeout, wait)));
+                }
+                if (poll(fds, nfds, timeout) < 0)
+                {
+                    if (errno != EINTR)
+                        perror("poll failed: ");
+                    continue;
+                }
+                if (fds[0].revents & POLLIN)
+                {
+                    uint64_t cnt;
+                    while (read(event_fd_, &cnt, sizeof(cnt)) > 0)
+                        ;
+                }
+                if (nfds == 2 && fds[1].revents)
+                    HandleSocket(fds[1].revents);
+            }
+        }
+
+        size_t PendingSize()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return pending_.size();
+        }
+
+        // 已连接、发送积压不多并且磁盘队列为空时放进发送缓冲区，否则追加到磁盘队列，保持日志顺序
+        void Enqueue(const std::string &batch)
+        {
+            frame_.clear();
+            Frame::Append(frame_, Frame::FRAME_DATA, batch.data(), batch.size(), compress_);
+            if (connected_ && spool_size_ == 0 && out_.size() - sent_ < max_inflight)
+            {
+                out_ += frame_;
+                return;
+            }
+            Spool(frame_, CountLines(batch));
+        }
+
+        void Spool(const std::string &frame, size_t lines)
+        {
+            if (spool_fd_ < 0 || spool_size_ + frame.size() > max_spool)
+            {
+                dropped_lines_.fetch_add(lines, std::memory_order_relaxed);
+                return;
+            }
+            if (write(spool_fd_, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size()))
+            {
+                perror("write spool file failed: ");
+                dropped_lines_.fetch_add(lines, std::memory_order_relaxed);
+                // 写了一部分的帧会破坏队列，截回写之前的长度
+                if (ftruncate(spool_fd_, spool_size_) < 0)
+                    perror("ftruncate spool file failed: ");
+                return;
+            }
+            spool_size_ += frame.size();
+            spooled_bytes_.fetch_add(frame.size(), std::memory_order_relaxed);
+        }
+
+        static size_t CountLines(const std::string &data)
+        {
+            size_t n = std::count(data.begin(), data.end(), '\n');
+            return n == 0 ? 1 : n;
+        }
+
+        // 发送缓冲区发完后再从磁盘队列读出完整的帧。读出的帧全部写入连接后才推进并记录
+        // spool_sent_，队列全部发出后清空文件
+        void FillFromSpool()
+        {
+            if (spool_fd_ < 0 || sent_ < out_.size() || spool_offset_ >= spool_size_)
+                return;
+            out_.clear();
+            sent_ = 0;
+            size_t want = std::min<size_t>(spool_chunk, spool_size_ - spool_offset_);
+            char header[Frame::header_size];
+            if (pread(spool_fd_, header, sizeof(header), spool_offset_) == sizeof(header))
+            {
+                Frame::Header h;
+                if (Frame::GetHeader(header, h))
+                    want = std::max<size_t>(want, Frame::header_size + h.payload_len);
+            }
+            out_.resize(want);
+            ssize_t n = pread(spool_fd_, &out_[0], want, spool_offset_);
+            if (n <= 0)
+            {
+                perror("read spool file failed: ");
+                out_.clear();
+                ResetSpool();
+                return;
+            }
+            out_.resize(FrameBoundary(out_, n));
+            if (out_.empty())
+            { // 队列文件损坏，丢弃剩余内容
+                std::cout << __FILE__ << __LINE__ << "corrupt spool file, discarded" << std::endl;
+                ResetSpool();
+                return;
+            }
+            spool_offset_ += out_.size();
+            out_spool_ = true;
+        }
+
+        // out_中来自磁盘队列的帧已经完整发出了sent_bytes字节
+        void SpoolSent(size_t sent_bytes)
+        {
+            spool_sent_ += sent_bytes;
+            spool_offset_ = spool_sent_; // 没发完的帧留在文件中，重连后重新读出
+            out_spool_ = false;
+            if (spool_sent_ >= spool_size_)
+                ResetSpool();
+            else
+                SaveSpoolOffset();
+        }
+
+        void ResetSpool()
+        {
+            if (ftruncate(spool_fd_, 0) < 0)
+                perror("ftruncate spool file failed: ");
+            spool_size_ = 0;
+            spool_offset_ = 0;
+            spool_sent_ = 0;
+            SaveSpoolOffset();
+        }
+
+        // 退出时重写磁盘队列：rest(比队列中的数据更早)在前，队列中还没发出的部分在后，
+        // 已经补发的前缀随之去掉
+        void CompactSpool(const std::string &rest)
+        {
+            if (spool_fd_ < 0)
+            {
+                if (!rest.empty())
+                    dropped_lines_.fetch_add(CountLines(rest), std::memory_order_relaxed);
+                return;
+            }
+            size_t remain = spool_size_ - spool_sent_;
+            if (rest.empty())
+            {
+                if (remain == 0)
+                    ResetSpool();
+                else
+                    SaveSpoolOffset();
+                return;
+            }
+            if (rest.size() + remain > max_spool)
+            {
+                dropped_lines_.fetch_add(CountLines(rest), std::memory_order_relaxed);
+                SaveSpoolOffset();
+                return;
+            }
+
+            std::string tmp_path = spool_path_ + ".tmp";
+            int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            bool ok = fd >= 0 && write(fd, rest.data(), rest.size()) == static_cast<ssize_t>(rest.size());
+            std::string chunk;
+            for (size_t off = spool_sent_; ok && off < spool_size_;)
+            {
+                chunk.resize(std::min<size_t>(spool_chunk, spool_size_ - off));
+                ssize_t n = pread(spool_fd_, &chunk[0], chunk.size(), off);
+                ok = n > 0 && write(fd, chunk.data(), n) == n;
+                off += n > 0 ? n : 0;
+            }
+            if (fd >= 0)
+                close(fd);
+            if (!ok || rename(tmp_path.c_str(), spool_path_.c_str()) < 0)
+            {
+                perror("rewrite spool file failed: ");
+                unlink(tmp_path.c_str());
+                dropped_lines_.fetch_add(CountLines(rest), std::memory_order_relaxed);
+                SaveSpoolOffset();
+                return;
+            }
+            spooled_bytes_.fetch_add(rest.size(), std::memory_order_relaxed);
+            spool_size_ = rest.size() + remain;
+            spool_sent_ = spool_offset_ = 0;
+            SaveSpoolOffset();
+        }
+
+        // data前len字节中完整帧的总长度
+        static size_t FrameBoundary(const std::string &data, size_t len)
+        {
+            size_t pos = 0;
+            Frame::Header h;
+            while (len - pos >= Frame::header_size && Frame::GetHeader(&data[pos], h) &&
+                   len - pos - Frame::header_size >= h.payload_len)
+                pos += Frame::header_size + h.payload_len;
+            return pos;
+        }
+
+        void Connect()
+        {
+            sock_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sock_ < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "socket error : " << strerror(errno) << std::endl;
+                Backoff();
+                return;
+            }
+            connect_deadline_ = Clock::now() + std::chrono::milliseconds(connect_timeout_ms);
+            if (connect(sock_, (struct sockaddr *)&server_, sizeof(server_)) == 0)
+                Connected();
+            else if (errno != EINPROGRESS)
+                Disconnect();
+        }
+
+        void Connected()
+        {
+            connected_ = true;
+            backoff_ms_ = min_backoff_ms;
+            connects_.fetch_add(1, std::memory_order_relaxed);
+            // 每个连接先发HELLO，断线时未发完的帧已经留在out_中
+            std::string hello;
+            Frame::Append(hello, Frame::FRAME_HELLO, source_.data(), source_.size());
+            out_.insert(0, hello);
+            hello_len_ = hello.size();
+        }
+
+        void HandleSocket(short revents)
+        {
+            if (!connected_)
+            {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (getsockopt(sock_, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+                {
+                    Disconnect();
+                    return;
+                }
+                Connected();
+            }
+            if (revents & (POLLIN | POLLERR | POLLHUP))
+            { // 接收端不会发数据，可读表示连接已关闭
+                char buf[256];
+                ssize_t n = recv(sock_, buf, sizeof(buf), 0);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+                {
+                    Disconnect();
+                    return;
+                }
+            }
+            SendOut();
+        }
+
+        void SendOut()
+        {
+            while (sent_ < out_.size())
+            {
+                ssize_t n = send(sock_, out_.data() + sent_, out_.size() - sent_, MSG_NOSIGNAL);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno != EAGAIN)
+                        Disconnect();
+                    return;
+                }
+                shipped_bytes_.fetch_add(n, std::memory_order_relaxed);
+                sent_ += n;
+            }
+            size_t from_spool = out_spool_ ? out_.size() - hello_len_ : 0;
+            out_.clear();
+            sent_ = 0;
+            hello_len_ = 0;
+            if (out_spool_)
+                SpoolSent(from_spool);
+        }
+
+        // out_中已经完整发出的帧的长度(不含HELLO)，以及剩余需要重发的数据的起点
+        void SentFrames(size_t &payload_done, size_t &rest_begin)
+        {
+            size_t done = FrameBoundary(out_, sent_);
+            payload_done = done - std::min(done, hello_len_);
+            rest_begin = std::max(done, hello_len_); // HELLO每个连接重新发送
+        }
+
+        void Disconnect()
+        {
+            if (sock_ >= 0)
+                close(sock_);
+            sock_ = -1;
+            if (connected_)
+            { // 接收端丢弃不完整的帧，去掉已经完整发出的帧，剩下的重连后整帧重发
+                size_t payload_done, rest_begin;
+                SentFrames(payload_done, rest_begin);
+                if (out_spool_)
+                { // 来自磁盘队列的帧不留在内存中，重连后从文件重新读出
+                    out_.clear();
+                    SpoolSent(payload_done);
+                }
+                else
+                    out_.erase(0, rest_begin);
+                sent_ = 0;
+                hello_len_ = 0;
+            }
+            connected_ = false;
+            Backoff();
+        }
+
+        // 指数退避并加入随机抖动，避免大量节点同时重连
+        void Backoff()
+        {
+            static thread_local std::minstd_rand rng(std::random_device{}());
+            int jitter = backoff_ms_ / 4;
+            int wait = backoff_ms_ - jitter + static_cast<int>(rng() % (2 * jitter + 1));
+            next_connect_ = Clock::now() + std::chrono::milliseconds(wait);
+            backoff_ms_ = std::min(backoff_ms_ * 2, max_backoff_ms);
+        }
+
+        // 退出时不等待网络：尽量非阻塞地发一次，剩下的整帧写回磁盘队列，下次启动后补发。
+        // 来自磁盘队列的帧本来就在文件中，只记录发到了哪里，不再重复写入
+        void Shutdown()
+        {
+            if (connected_)
+                SendOut();
+            std::string rest;
+            if (connected_)
+            {
+                size_t payload_done, rest_begin;
+                SentFrames(payload_done, rest_begin);
+                if (out_spool_)
+                    SpoolSent(payload_done);
+                else
+                    rest = out_.substr(rest_begin);
+            }
+            else if (!out_spool_)
+                rest = out_;
+            if (sock_ >= 0)
+                close(sock_);
+            sock_ = -1;
+            out_.clear();
+            CompactSpool(rest);
+        }
+
+    private:
+        uint16_t port_;
+        bool compress_;
+        std::string spool_path_;
+        std::string source_; // HELLO帧中的发送端名字: 主机名
+        struct sockaddr_in server_;
+        int event_fd_ = -1;
+        std::thread thread_;
+        std::atomic<bool> stop_{false};
+
+        std::mutex mtx_;
+        std::string pending_; // 调用线程追加，由mtx_保护
+
+        // 以下只由后台线程访问
+        int sock_ = -1;
+        bool connected_ = false;
+        int backoff_ms_ = min_backoff_ms;
+        Clock::time_point next_connect_;
+        Clock::time_point connect_deadline_;
+        std::string frame_;
+        std::string out_;  // 已组帧待发送的数据
+        size_t sent_ = 0;  // out_中已经发出的字节数
+        size_t hello_len_ = 0;    // out_开头HELLO帧的长度，没有时为0
+        bool out_spool_ = false;  // out_中除HELLO外的帧来自磁盘队列[spool_sent_, spool_offset_)
+        int spool_fd_ = -1;
+        int offset_fd_ = -1;
+        size_t spool_size_ = 0;
+        size_t spool_offset_ = 0; // 磁盘队列中已经读出的位置
+        size_t spool_sent_ = 0;   // 磁盘队列中已经完整发出的位置，持久化到offset文件
+
+        std::atomic<uint64_t> shipped_bytes_{0};
+        std::atomic<uint64_t> spooled_bytes_{0};
+        std::atomic<uint64_t> dropped_lines_{0};
+        std::atomic<uint64_t> connects_{0};
+    };
+} // namespace mylog
@@ -1,60 +1,169 @@
 // 远程备份debug等级以上的日志信息-接收端
+// 编译: g++ -std=c++17 -O2 ServerBackupLog.cpp -o ServerBackupLog -ljsoncpp -pthread
+//      (接收压缩的日志时加 -DMYLOG_USE_ZLIB -lz)
+// 用法: ServerBackupLog port [dir]，每个来源的日志写到 dir/<来源名>/ 下的滚动文件，
+//      来源名是发送端的主机名，同一台主机上的进程共用一组文件
 #include <string>
 #include <cassert>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include <iostream>
 #include <unistd.h>
 #include <memory>
+#include <unordered_map>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include "../AsyncWorker.hpp"
+#include "../LogFlush.hpp"
 #include "ServerBackupLog.hpp"
 using std::cout;
 using std::endl;
-const std::string filename = "./logfile.log";
+
+mylog::Util::JsonData *g_conf_data;
+const size_t roll_size = 64 * 1024 * 1024;
+const time_t idle_close_sec = 5 * 60; // 来源超过该时间没有日志就关闭它的文件
+
 void usage(std::string procgress)
 {
-    cout << "usage error:" << procgress << "port" << endl;
-}
-bool file_exist(const std::string &name)
-{
-    struct stat exist;
-    return (stat(name.c_str(), &exist) == 0);
+    cout << "usage error:" << procgress << " port [dir]" << endl;
 }
 
-void backup_log(const std::string &message)//用作回调
+// 事件循环把收到的日志连同来源名写入异步工作器的缓冲区，不在循环里做磁盘IO；
+// 后台线程按来源分组，每个来源每批只调用一次对应滚动文件的Flush；
+// 长时间没有日志的来源会关闭文件并释放缓冲，发送端重启或换了进程不会让它们一直累积
+class SourceStore
 {
-    FILE *fp = fopen(filename.c_str(), "ab");
-    if (fp == NULL)
+public:
+    explicit SourceStore(const std::string &dir)
+        : dir_(dir),
+          worker_(std::bind(&SourceStore::RealFlush, this, std::placeholders::_1))
     {
-        perror("fopen error: ");
-        assert(false);
     }
-    int write_byte = fwrite(message.c_str(), 1, message.size(), fp);
-    if (write_byte != message.size())
+
+    // 由事件循环调用，缓冲区满时阻塞，反压到各发送端的连接上
+    void Append(const std::string &source, const char *data, size_t len)
     {
-        perror("fwrite error: ");
-        assert(false);
+        record_.clear();
+        uint16_t name_len = static_cast<uint16_t>(std::min<size_t>(source.size(), UINT16_MAX));
+        uint32_t data_len = static_cast<uint32_t>(len);
+        record_.append(reinterpret_cast<const char *>(&name_len), sizeof(name_len));
+        record_.append(source.data(), name_len);
+        record_.append(reinterpret_cast<const char *>(&data_len), sizeof(data_len));
+        record_.append(data, len);
+        worker_.Push(record_.data(), record_.size());
     }
-    fflush(fp);
-    fclose(fp);
-}
+
+private:
+    void RealFlush(mylog::Buffer &buffer)
+    {
+        time_t now = time(nullptr);
+        const char *p = buffer.Begin();
+        const char *end = p + buffer.ReadableSize();
+        while (end - p >= static_cast<ptrdiff_t>(sizeof(uint16_t)))
+        {
+            uint16_t name_len;
+            uint32_t data_len;
+            memcpy(&name_len, p, sizeof(name_len));
+            p += sizeof(name_len);
+            std::string key = SourceKey(std::string(p, name_len));
+            p += name_len;
+            memcpy(&data_len, p, sizeof(data_len));
+            p += sizeof(data_len);
+            Source &src = sources_[key];
+            src.batch.append(p, data_len);
+            src.last_used = now;
+            p += data_len;
+        }
+        for (auto &it : sources_)
+        {
+            Source &src = it.second;
+            if (src.batch.empty())
+                continue;
+            if (!src.flush)
+                src.flush = std::make_shared<mylog::RollFileFlush>(
+                    dir_ + "/" + SafeName(it.first) + "/backup-", roll_size);
+            src.flush->Flush(src.batch.data(), src.batch.size());
+            src.batch.clear();
+        }
+        CloseIdle(now);
+    }
+
+    // 回调只在有数据时执行，所以空闲来源在下一批日志到达时才被关闭
+    void CloseIdle(time_t now)
+    {
+        if (now - last_sweep_ < 60)
+            return;
+        last_sweep_ = now;
+        for (auto it = sources_.begin(); it != sources_.end();)
+        {
+            if (now - it->second.last_used >= idle_close_sec)
+                it = sources_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // 旧版发送端的来源名是"主机名:进程号"，去掉进程号，按主机归档
+    static std::string SourceKey(const std::string &source)
+    {
+        size_t colon = source.rfind(':');
+        if (colon == std::string::npos || colon + 1 == source.size())
+            return source;
+        for (size_t i = colon + 1; i < source.size(); ++i)
+            if (!isdigit(static_cast<unsigned char>(source[i])))
+                return source;
+        return source.substr(0, colon);
+    }
+
+    // 来源名由发送端决定，只保留可以安全用作目录名的字符
+    static std::string SafeName(const std::string &source)
+    {
+        std::string name;
+        for (char ch : source)
+            name.push_back(isalnum(static_cast<unsigned char>(ch)) || ch == '-' || ch == '_' || ch == '.' || ch == ':'
+                               ? ch : '_');
+        if (name.empty() || name == "." || name == "..")
+            name = "unknown";
+        return name;
+    }
+
+private:
+    std::string dir_;
+    std::string record_; // 只由事件循环使用
+    // 以下只由后台线程使用
+    struct Source
+    {
+        std::string batch;          // 本批收到的日志
+        mylog::LogFlush::ptr flush; // 第一次有数据时创建
+        time_t last_used = 0;       // 最近一次收到日志的时间
+    };
+    std::unordered_map<std::string, Source> sources_;
+    time_t last_sweep_ = 0;
+    mylog::AsyncWorker worker_; // 最后构造、最先析构，退出前把剩余数据写完
+};
+
 int main(int args, char *argv[])
 {
-    if (args != 2)
+    if (args != 2 && args != 3)
     {
         usage(argv[0]);
         perror("usage error");
         exit(-1);
     }
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
 
     uint16_t port = atoi(argv[1]);
-    std::unique_ptr<TcpServer> tcp(new TcpServer(port, backup_log));
+    SourceStore store(args == 3 ? argv[2] : "./logfile");
+    std::unique_ptr<TcpServer> tcp(new TcpServer(
+        port, std::bind(&SourceStore::Append, &store, std::placeholders::_1,
+                        std::placeholders::_2, std::placeholders::_3)));
 
-    tcp->init_service();
+    if (!tcp->init_service())
+        exit(-1);
     tcp->start_service();
 
     return 0;
-}
\ No newline at end of file
+}
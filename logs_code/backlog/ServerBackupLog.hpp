@@ -1,122 +1,234 @@
+// 远程备份日志的接收端服务器：单线程epoll事件循环，所有发送端的长连接都由它处理。
+// 每个连接按BackupFrame.hpp的帧格式解析，HELLO帧确定来源名，DATA帧中的日志交给回调
 #pragma once
 #include <iostream>
 #include <string>
+#include <unordered_map>
 #include <unistd.h>
 #include <cstring>
 #include <cerrno>
 #include <cstdlib>
-#include <pthread.h>
-#include <mutex>
+#include <fcntl.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <functional>
+#include "BackupFrame.hpp"
 
 using std::cout;
 using std::endl;
 
-using func_t = std::function<void(const std::string &)>;
-const int backlog = 32;
-
-class TcpServer;
-//该类包含客户端的ip和端口信息
-class ThreadData
-{
-public:
-    ThreadData(int fd, const std::string &ip, const uint16_t &port, TcpServer *ts)
-        : sock(fd),client_ip(ip),client_port(port),ts_(ts){}
-
-public:
-    int sock;
-    std::string client_ip;
-    uint16_t client_port;
-    TcpServer *ts_;
-};
+// 参数依次为来源名、日志数据、长度，数据由若干行完整的日志组成
+using func_t = std::function<void(const std::string &, const char *, size_t)>;
+const int backlog = 1024;
 
 class TcpServer
 {
 public:
+    static constexpr int max_events = 256;
+    static constexpr size_t read_size = 64 * 1024;
+    static constexpr int max_reads = 16; // 一个连接每轮最多读的次数，避免一个连接占住循环
+
     TcpServer(uint16_t port, func_t func)
         : port_(port), func_(func)
     {
     }
-    void init_service()
+    ~TcpServer()
+    {
+        for (auto &it : conns_)
+            close(it.first);
+        if (epfd_ >= 0)
+            close(epfd_);
+        if (listen_sock_ >= 0)
+            close(listen_sock_);
+    }
+
+    bool init_service()
     {
-        // 创建
-        listen_sock_ = socket(AF_INET, SOCK_STREAM, 0);
+        listen_sock_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
         if (listen_sock_ == -1){
             std::cout << __FILE__ << __LINE__ <<"create socket error"<< strerror(errno)<< std::endl;
+            return false;
         }
+        int opt = 1;
+        setsockopt(listen_sock_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
         struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
         local.sin_family = AF_INET;
         local.sin_port = htons(port_);
         local.sin_addr.s_addr = htonl(INADDR_ANY);
 
         if (bind(listen_sock_, (struct sockaddr *)&local, sizeof(local)) < 0){
             std::cout << __FILE__ << __LINE__ << "bind socket error"<< strerror(errno)<< std::endl;
+            return false;
         }
 
         if (listen(listen_sock_, backlog) < 0) {
             std::cout << __FILE__ << __LINE__ <<  "listen error"<< strerror(errno)<< std::endl;
+            return false;
         }
+
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            std::cout << __FILE__ << __LINE__ << "epoll_create error" << strerror(errno) << std::endl;
+            return false;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_sock_;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_sock_, &ev);
+        return true;
     }
 
-    static void *threadRoutine(void *args)
+    void start_service()
     {
-        pthread_detach(pthread_self()); // 防止在start_service处阻塞
-
-        ThreadData *td = static_cast<ThreadData *>(args);
-        std::string client_info = td->client_ip + ":" + std::to_string(td->client_port);
-        td->ts_->service(td->sock,move(client_info));
-        close(td->sock);
-        delete td;
-        return nullptr;
+        struct epoll_event events[max_events];
+        while (true)
+        {
+            int n = epoll_wait(epfd_, events, max_events, -1);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cout << __FILE__ << __LINE__ << "epoll_wait error" << strerror(errno) << std::endl;
+                return;
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listen_sock_)
+                    accept_all();
+                else
+                    service(fd);
+            }
+        }
     }
 
-    void start_service()
+private:
+    struct Connection
+    {
+        std::string client_info; // ip:port
+        std::string source;      // HELLO帧中的来源名，收到之前使用客户端ip
+        std::string buf;         // 尚未凑成完整帧的数据
+        std::string inflate;     // 解压缓冲
+    };
+
+    void accept_all()
     {
         while (true)
         {
             struct sockaddr_in client_addr;
             socklen_t client_addrlen = sizeof(client_addr);
-            int connfd = accept(listen_sock_, (struct sockaddr *)&client_addr, &client_addrlen);
+            int connfd = accept4(listen_sock_, (struct sockaddr *)&client_addr, &client_addrlen,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC);
             if (connfd < 0){
-                std::cout << __FILE__ << __LINE__ << "accept error"<< strerror(errno)<< std::endl;
-                continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    std::cout << __FILE__ << __LINE__ << "accept error"<< strerror(errno)<< std::endl;
+                return;
             }
 
             // 获取client端信息
             std::string client_ip = inet_ntoa(client_addr.sin_addr); // 网络序列转字符串
             uint16_t client_port = ntohs(client_addr.sin_port);
 
-            // 多个线程提供服务
-            // 传入线程数据类型来访问threadRoutine，因为该函数是static的，所以内部传入了data类型存了tcpserver类型
-            pthread_t tid;
-            ThreadData *td = new ThreadData(connfd, client_ip, client_port, this);
-            pthread_create(&tid, nullptr, threadRoutine, td);
+            Connection &conn = conns_[connfd];
+            conn.client_info = client_ip + ":" + std::to_string(client_port);
+            conn.source = client_ip;
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = connfd;
+            if (epoll_ctl(epfd_, EPOLL_CTL_ADD, connfd, &ev) < 0)
+            {
+                std::cout << __FILE__ << __LINE__ << "epoll_ctl error" << strerror(errno) << std::endl;
+                close_conn(connfd);
+            }
+        }
+    }
+
+    void service(int sock)
+    {
+        auto it = conns_.find(sock);
+        if (it == conns_.end())
+            return;
+        Connection &conn = it->second;
+        bool closed = false;
+        for (int i = 0; i < max_reads; ++i)
+        {
+            ssize_t r_ret = read(sock, rbuf_, sizeof(rbuf_));
+            if (r_ret == 0)
+            {
+                closed = true;
+                break;
+            }
+            if (r_ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    std::cout << __FILE__ << __LINE__ << "read error" << strerror(errno) << std::endl;
+                    closed = true;
+                }
+                break;
+            }
+            conn.buf.append(rbuf_, r_ret);
+            if (static_cast<size_t>(r_ret) < sizeof(rbuf_))
+                break;
+        }
+        if (!parse(conn))
+        {
+            std::cout << __FILE__ << __LINE__ << "bad frame from " << conn.client_info << std::endl;
+            closed = true;
         }
+        // 关闭时未凑成完整帧的数据丢弃，发送端会整帧重发
+        if (closed)
+            close_conn(sock);
     }
 
-    void service(int sock,const std::string&& client_info)
+    // 处理缓冲区中所有完整的帧，数据错误时返回false
+    bool parse(Connection &conn)
     {
-        char buf[1024];
-
-        int r_ret = read(sock, buf, sizeof(buf));
-        if(r_ret ==-1){
-            std::cout << __FILE__ << __LINE__ <<"read error"<< strerror(errno)<< std::endl;
-            perror("NULL");
-        }else if(r_ret > 0){
-            buf[r_ret] = 0;
-            std::string tmp = buf;
-            func_(client_info+tmp); // 进行回调
+        size_t pos = 0;
+        mylog::Frame::Header h;
+        while (conn.buf.size() - pos >= mylog::Frame::header_size)
+        {
+            if (!mylog::Frame::GetHeader(&conn.buf[pos], h))
+                return false;
+            if (conn.buf.size() - pos - mylog::Frame::header_size < h.payload_len)
+                break;
+            const char *payload = &conn.buf[pos + mylog::Frame::header_size];
+            pos += mylog::Frame::header_size + h.payload_len;
+            if (h.type == mylog::Frame::FRAME_HELLO)
+            {
+                conn.source.assign(payload, h.payload_len);
+                continue;
+            }
+            const char *data;
+            size_t len;
+            if (!mylog::Frame::Payload(h, payload, conn.inflate, data, len))
+                return false;
+            if (len > 0)
+                func_(conn.source, data, len); // 进行回调
         }
+        conn.buf.erase(0, pos);
+        return true;
+    }
+
+    void close_conn(int sock)
+    {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, sock, nullptr);
+        close(sock);
+        conns_.erase(sock);
     }
-    ~TcpServer()=default;
 
 private:
-    int listen_sock_;
+    int listen_sock_ = -1;
+    int epfd_ = -1;
     uint16_t port_;
     func_t func_;
-};
\ No newline at end of file
+    std::unordered_map<int, Connection> conns_;
+    char rbuf_[read_size];
+};
@@ -0,0 +1,314 @@
+/*
+ * 日志性能基准: 比较code/log的Log和logs_code的mylog::AsyncLogger
+ *   - 每次调用的生产者延迟直方图(p50/p99/p999/max)
+ *   - 1~64个生产者线程下的吞吐
+ *   - 缓冲区写满(落地很慢或队列很小)时的表现: 延迟、阻塞和丢弃的行数
+ * 每个测试输出一行JSON到标准输出，进度信息输出到标准错误。
+ * code/log的Log是单例, 队列容量只在第一次init时确定, 所以它的每个测试在单独的子进程里运行。
+ *
+ * 编译: make bench
+ * 用法: ./bench_log [--threads 1,2,4,8,16,32,64] [--lines 1000000] [--logger all|log|mylog|mylog_deferred]
+ *                   [--scenario all|throughput|full] [--dir ./bench_out]
+ */
+#include "../code/log/log.h"
+#include "../logs_code/MyLog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+mylog::Util::JsonData* g_conf_data;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* 对数-线性直方图: 64ns以内每纳秒一个桶, 之后每个2的幂区间分32个桶, 相对误差不超过1/32 */
+class Histogram {
+public:
+    static const int SUB_BITS = 5;
+    static const int LINEAR = 64;
+    static const int BUCKETS = LINEAR + (64 - 6) * (1 << SUB_BITS);
+
+    Histogram() : counts_(BUCKETS, 0) {}
+
+    void Record(uint64_t ns) {
+        counts_[Index(ns)]++;
+        count_++;
+        max_ = std::max(max_, ns);
+    }
+
+    void Merge(const Histogram& other) {
+        for(int i = 0; i < BUCKETS; i++) { counts_[i] += other.counts_[i]; }
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    /* q在0~1之间, 返回对应桶的上界 */
+    uint64_t Percentile(double q) const {
+        if(count_ == 0) { return 0; }
+        uint64_t target = static_cast<uint64_t>(q * count_);
+        if(target >= count_) { target = count_ - 1; }
+        uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+            if(seen > target) { return std::min(UpperBound(i), max_); }
+        }
+        return max_;
+    }
+
+    uint64_t Count() const { return count_; }
+    uint64_t Max() const { return max_; }
+
+private:
+    static int Index(uint64_t v) {
+        if(v < LINEAR) { return static_cast<int>(v); }
+        int e = 63 - __builtin_clzll(v);           /* v在[2^e, 2^(e+1))中, e >= 6 */
+        int sub = static_cast<int>((v >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+        return LINEAR + (e - 6) * (1 << SUB_BITS) + sub;
+    }
+
+    static uint64_t UpperBound(int index) {
+        if(index < LINEAR) { return index; }
+        int e = (index - LINEAR) / (1 << SUB_BITS) + 6;
+        uint64_t sub = (index - LINEAR) % (1 << SUB_BITS);
+        uint64_t width = 1ULL << (e - SUB_BITS);
+        return (1ULL << e) + (sub + 1) * width - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct Options {
+    std::vector<int> threads = {1, 2, 4, 8, 16, 32, 64};
+    uint64_t lines = 1000000;          /* 每个测试所有线程写的总行数 */
+    std::string logger = "all";
+    std::string scenario = "all";
+    std::string dir = "./bench_out";
+};
+
+struct Result {
+    std::string logger;
+    std::string scenario;
+    int threads = 0;
+    uint64_t lines = 0;
+    double producerSec = 0;            /* 所有生产者写完的时间 */
+    double totalSec = -1;              /* 包括后台线程写完的时间, 无法测量时为-1 */
+    Histogram hist;
+    uint64_t dropped = 0;
+    uint64_t blocked = 0;
+};
+
+/* 日志内容: 一个字符串, 两个整数, 一个浮点数, 格式化后约100字节 */
+const char* const kFormat = "request %s finished status=%d bytes=%d elapsed=%.3fms client connection keep-alive";
+
+/* threads个线程同时开始, 每个线程写lines/threads行, 每次调用单独计时 */
+void RunProducers(int threads, uint64_t lines, const std::function<void(int, int)>& call, Result& r) {
+    std::vector<Histogram> hists(threads);
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    uint64_t perThread = lines / threads;
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            Histogram& h = hists[t];
+            ready.fetch_add(1);
+            while(!go.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+            for(uint64_t i = 0; i < perThread; i++) {
+                auto begin = Clock::now();
+                call(t, static_cast<int>(i));
+                auto end = Clock::now();
+                h.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+            }
+        });
+    }
+    while(ready.load() < threads) { std::this_thread::yield(); }
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for(auto& w : workers) { w.join(); }
+    r.producerSec = std::chrono::duration<double>(Clock::now() - start).count();
+    r.threads = threads;
+    r.lines = perThread * threads;
+    for(auto& h : hists) { r.hist.Merge(h); }
+}
+
+void Print(const Result& r) {
+    double producerRate = r.producerSec > 0 ? r.lines / r.producerSec : 0;
+    double totalRate = r.totalSec > 0 ? r.lines / r.totalSec : -1;
+    printf("{\"logger\":\"%s\",\"scenario\":\"%s\",\"threads\":%d,\"lines\":%llu,"
+           "\"producer_sec\":%.6f,\"producer_lines_per_sec\":%.0f,"
+           "\"total_sec\":%.6f,\"total_lines_per_sec\":%.0f,"
+           "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,"
+           "\"dropped\":%llu,\"blocked\":%llu}\n",
+           r.logger.c_str(), r.scenario.c_str(), r.threads,
+           static_cast<unsigned long long>(r.lines), r.producerSec, producerRate,
+           r.totalSec, totalRate,
+           static_cast<unsigned long long>(r.hist.Percentile(0.50)),
+           static_cast<unsigned long long>(r.hist.Percentile(0.99)),
+           static_cast<unsigned long long>(r.hist.Percentile(0.999)),
+           static_cast<unsigned long long>(r.hist.Max()),
+           static_cast<unsigned long long>(r.dropped),
+           static_cast<unsigned long long>(r.blocked));
+    fflush(stdout);
+}
+
+/* code/log: full场景把队列设得很小, 满了退化为同步写, 同步写的行数记为blocked */
+Result BenchLog(const Options& opt, const std::string& scenario, int threads) {
+    Result r;
+    r.logger = "log";
+    r.scenario = scenario;
+    static std::string path;   /* init只保存指针, 路径要一直有效 */
+    path = opt.dir + "/log_" + scenario + "_" + std::to_string(threads);
+    Log::Instance()->init(1, path.c_str(), ".log", scenario == "full" ? 16 : 1 << 16);
+    RunProducers(threads, opt.lines, [](int t, int i) {
+        LOG_INFO(kFormat, "/api/v1/items", 200 + t, i, i * 0.001);
+    }, r);
+    Log::Instance()->flush();
+    r.blocked = Log::Instance()->SyncFallbacks();
+    return r;
+}
+
+/* 在子进程里运行BenchLog并输出结果, 父进程从不init单例, 每个测试都得到新的队列 */
+void RunLogInChild(const Options& opt, const std::string& scenario, int threads) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return;
+    }
+    if(pid == 0) {
+        Print(BenchLog(opt, scenario, threads));
+        exit(0);   /* 单例析构时写线程把队列里剩下的日志写完 */
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "log %s threads=%d failed\n", scenario.c_str(), threads);
+    }
+}
+
+/* 慢落地: 每批数据额外等待一段时间, 模拟每批fsync的磁盘 */
+class SlowFlush : public mylog::LogFlush {
+public:
+    SlowFlush(mylog::LogFlush::ptr inner, int delayUs) : inner_(inner), delayUs_(delayUs) {}
+    void Flush(const char* data, size_t len) override {
+        inner_->Flush(data, len);
+        usleep(delayUs_);
+    }
+private:
+    mylog::LogFlush::ptr inner_;
+    int delayUs_;
+};
+
+/* mylog: 每个测试新建一个日志器, 析构时等后台线程写完, 以此计算端到端吞吐.
+   full场景缓冲区只有256KiB且落地很慢, 分别测试阻塞和丢弃两种溢出策略 */
+Result BenchMyLog(const Options& opt, const std::string& scenario, int threads, bool deferred,
+                  mylog::OverflowPolicy::Action action) {
+    Result r;
+    r.logger = deferred ? "mylog_deferred" : "mylog";
+    r.scenario = scenario;
+    if(scenario == "full") {
+        r.scenario += action == mylog::OverflowPolicy::Action::BLOCK ? "_block" : "_drop";
+    }
+    g_conf_data->buffer_size = scenario == "full" ? 256 * 1024 : 16 * 1024 * 1024;
+
+    std::string file = opt.dir + "/" + r.logger + "_" + r.scenario + "_" + std::to_string(threads) + ".log";
+    mylog::LogFlush::ptr flush = std::make_shared<mylog::FileFlush>(file);
+    if(scenario == "full") { flush = std::make_shared<SlowFlush>(flush, 2000); }
+    std::vector<mylog::Route> routes{mylog::Route{flush}};
+    mylog::OverflowPolicy policy;
+    policy.action = action;
+    auto logger = std::make_shared<mylog::AsyncLogger>(r.logger, routes, policy);
+
+    auto start = Clock::now();
+    if(deferred) {
+        RunProducers(threads, opt.lines, [&logger](int t, int i) {
+            MYLOG_INFO(logger, "request %s finished status=%d bytes=%d elapsed=%.3fms client connection keep-alive",
+                       "/api/v1/items", 200 + t, i, i * 0.001);
+        }, r);
+    } else {
+        RunProducers(threads, opt.lines, [&logger](int t, int i) {
+            logger->Info(kFormat, "/api/v1/items", 200 + t, i, i * 0.001);
+        }, r);
+    }
+    mylog::OverflowStats stats = logger->Stats();
+    logger.reset();   /* 析构时后台线程把剩余的日志写完 */
+    r.totalSec = std::chrono::duration<double>(Clock::now() - start).count();
+    r.dropped = stats.dropped_lines;
+    r.blocked = stats.blocked_lines;
+    return r;
+}
+
+std::vector<int> ParseList(const char* s) {
+    std::vector<int> v;
+    while(*s) {
+        v.push_back(atoi(s));
+        const char* comma = strchr(s, ',');
+        if(!comma) { break; }
+        s = comma + 1;
+    }
+    return v;
+}
+
+void Usage(const char* prog) {
+    fprintf(stderr, "usage: %s [--threads 1,2,4,...] [--lines N] [--logger all|log|mylog|mylog_deferred]"
+                    " [--scenario all|throughput|full] [--dir DIR]\n", prog);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(i + 1 >= argc) { Usage(argv[0]); return 1; }
+        const char* value = argv[++i];
+        if(arg == "--threads") { opt.threads = ParseList(value); }
+        else if(arg == "--lines") { opt.lines = strtoull(value, nullptr, 10); }
+        else if(arg == "--logger") { opt.logger = value; }
+        else if(arg == "--scenario") { opt.scenario = value; }
+        else if(arg == "--dir") { opt.dir = value; }
+        else { Usage(argv[0]); return 1; }
+    }
+    mkdir(opt.dir.c_str(), 0755);
+
+    /* 不依赖config.conf, 基准需要的参数在这里固定 */
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
+    g_conf_data->threshold = 64 * 1024 * 1024;
+    g_conf_data->linear_growth = 16 * 1024 * 1024;
+    g_conf_data->flush_log = 0;
+
+    auto want = [&opt](const std::string& logger, const std::string& scenario) {
+        return (opt.logger == "all" || opt.logger == logger) &&
+               (opt.scenario == "all" || opt.scenario == scenario);
+    };
+    using Action = mylog::OverflowPolicy::Action;
+    for(const char* scenario : {"throughput", "full"}) {
+        for(int threads : opt.threads) {
+            if(threads <= 0) { continue; }
+            fprintf(stderr, "%s threads=%d\n", scenario, threads);
+            if(want("log", scenario)) { RunLogInChild(opt, scenario, threads); }
+            for(bool deferred : {false, true}) {
+                if(!want(deferred ? "mylog_deferred" : "mylog", scenario)) { continue; }
+                if(std::string(scenario) == "throughput") {
+                    Print(BenchMyLog(opt, scenario, threads, deferred, Action::GROW));
+                } else {
+                    Print(BenchMyLog(opt, scenario, threads, deferred, Action::BLOCK));
+                    Print(BenchMyLog(opt, scenario, threads, deferred, Action::DROP_NEWEST));
+                }
+            }
+        }
+    }
+    return 0;
+}